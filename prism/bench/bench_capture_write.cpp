@@ -0,0 +1,221 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/19.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+// 抓包文件写出吞吐
+// 用法: bench_capture_write [总量 MB, 默认 1024] [输出目录, 默认系统临时目录] [限速时长秒, 默认 2]
+//
+// 同一组记录 (16 字节 pcap 记录头 + 54 字节以太网/IPv4/TCP 头 + 1400 字节明文) 按以下方式写出:
+//   reopen: 旧的写法, 记录拷贝进缓存, 每 CACHING_BUFFER_MAX_BYTES 检查一次文件是否存在,
+//           复制整个缓存插入全局头, 以 Append 打开写入后关闭
+//   writev: CaptureFile 整个抓包期间只打开一次, 报文头进 RecordChain, 明文只引用, 一次 writev 写出
+//   mmap:   CaptureFile 的 fallocate + mmap 窗口, 仅 Linux
+//   uring:  CaptureFile 的 io_uring 异步提交, 仅 Linux, 内核不支持时跳过
+//
+// 先不限速写出总量, 得到各方式的最大写入速度
+// 再按 1GbE (125 MB/s) 与 10GbE (1250 MB/s) 的速率限速写出, 每次写盘前等到该速率下应有的时间,
+// 得到该速率下写线程的 CPU 占用, 单次写盘的最长耗时, 以及结束时落后于该速率的时间
+// 计时包括打开与关闭文件, 不包括落盘; CPU 时间为进程时间, 不含内核异步写的线程
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include <cstdio>
+#include <ctime>
+#include "capture_file.h"
+#include "dump.h"
+
+
+#define BENCH_HEADER_BYTES          (sizeof(PCAPREC_HDR) + 54)
+#define BENCH_PAYLOAD_BYTES         1400
+
+#define BENCH_RATE_1GBE             (125 * 1000 * 1000)
+#define BENCH_RATE_10GBE            (1250 * 1000 * 1000)
+
+// 每种方式写一个文件的写法
+enum BENCH_MODE {
+    BENCH_MODE_REOPEN,
+    BENCH_MODE_WRITEV,
+    BENCH_MODE_MMAP,
+    BENCH_MODE_URING,
+};
+
+typedef struct BENCH_RESULT_ {
+    bool        ok = false;
+    double      wallSec = 0;
+    double      cpuSec = 0;
+    double      maxFlushMs = 0;     // 单次写盘的最长耗时
+    double      lagSec = 0;         // 限速时结束时刻落后于目标速率的时间
+} BENCH_RESULT;
+
+
+static const char *modeName(const BENCH_MODE mode) {
+
+    switch ( mode ) {
+    case BENCH_MODE_REOPEN: return "reopen";
+    case BENCH_MODE_WRITEV: return "writev";
+    case BENCH_MODE_MMAP:   return "mmap";
+    case BENCH_MODE_URING:  return "uring";
+    }
+    return "";
+}
+
+// 旧的写盘方式, 与改动前 dump.cpp 中的 writePktsOut 相同
+static bool writeReopen(const QString &filePath, const QByteArray &fileContent) {
+
+    auto bs = fileContent;
+
+    if ( !QFile(filePath).exists() ) {
+        PCAP_HDR capHdr = {};
+        capHdr.magic_number     = 0xa1b2c3d4;
+        capHdr.version_major    = 0x02;
+        capHdr.version_minor    = 0x04;
+        capHdr.snaplen          = 0xA0000000;
+        capHdr.network          = CAPTURE_LINKTYPE_ETHERNET;
+        bs.insert(0, reinterpret_cast<const char *>(&capHdr), sizeof(capHdr));
+    }
+
+    QFile file(filePath);
+    if ( !file.open(QIODevice::Append) ) {
+        return false;
+    }
+    return file.write(bs) == bs.size();
+}
+
+// rate 为 0 时不限速, 否则每次写盘前等到按 rate 字节/秒 写到此处应有的时间
+static BENCH_RESULT runMode(const BENCH_MODE mode, const QString &filePath, const qint64 records,
+    const QByteArray &header, const QByteArray &payload, const qint64 rate) {
+
+    BENCH_RESULT result;
+    QFile::remove(filePath);
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::clock_t cpu = std::clock();
+
+    CaptureFile file;
+    if ( mode != BENCH_MODE_REOPEN ) {
+        const CAPTURE_IO io = mode == BENCH_MODE_MMAP ? CAPTURE_IO_MMAP :
+                              mode == BENCH_MODE_URING ? CAPTURE_IO_URING : CAPTURE_IO_FILE;
+        file.setIo(io);
+        if ( !file.open(filePath, CAPTURE_FORMAT_PCAP) ) {
+            std::fprintf(stderr, "%s: open %s failed\n", modeName(mode), qPrintable(filePath));
+            return result;
+        }
+    }
+
+    QByteArray caching;
+    RecordChain chain;
+    qint64 produced = 0;
+    result.ok = true;
+
+    for ( qint64 i = 0; i < records && result.ok; i++ ) {
+        if ( mode == BENCH_MODE_REOPEN ) {
+            caching.append(header);
+            caching.append(payload);
+        } else {
+            chain.appendHeader(header.constData(), header.size());
+            chain.appendPayload(payload);
+        }
+        produced += header.size() + payload.size();
+
+        const qsizetype pending = mode == BENCH_MODE_REOPEN ? caching.size() : chain.bytes();
+        if ( pending < CACHING_BUFFER_MAX_BYTES && i != records - 1 ) {
+            continue;
+        }
+
+        if ( rate > 0 ) {
+            const qint64 dueNs = produced * 1000000000 / rate;
+            const qint64 aheadNs = dueNs - timer.nsecsElapsed();
+            if ( aheadNs > 0 ) {
+                QThread::usleep(static_cast<unsigned long>(aheadNs / 1000));
+            }
+        }
+
+        const qint64 flushStart = timer.nsecsElapsed();
+        if ( mode == BENCH_MODE_REOPEN ) {
+            result.ok = writeReopen(filePath, caching);
+            caching.clear();
+        } else {
+            result.ok = file.write(chain);
+        }
+        result.maxFlushMs = qMax(result.maxFlushMs, (timer.nsecsElapsed() - flushStart) / 1e6);
+    }
+    file.close();
+
+    if ( !result.ok ) {
+        std::fprintf(stderr, "%s: write failed\n", modeName(mode));
+    }
+    result.wallSec = timer.nsecsElapsed() / 1e9;
+    result.cpuSec = static_cast<double>(std::clock() - cpu) / CLOCKS_PER_SEC;
+    if ( rate > 0 ) {
+        result.lagSec = qMax(0.0, result.wallSec - static_cast<double>(produced) / rate);
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+    const QStringList args = QCoreApplication::arguments();
+
+    const qint64 totalMb = args.size() > 1 ? args.at(1).toLongLong() : 1024;
+    const QString dir = args.size() > 2 ? args.at(2) : QDir::tempPath();
+    const qint64 pacedSec = args.size() > 3 ? args.at(3).toLongLong() : 2;
+    const QString filePath = QDir(dir).filePath(QStringLiteral("bench_capture_write.pcap"));
+
+    const QByteArray header(BENCH_HEADER_BYTES, 'h');
+    const QByteArray payload(BENCH_PAYLOAD_BYTES, 'p');
+    const qint64 recordBytes = header.size() + payload.size();
+
+    QList<BENCH_MODE> modes = {BENCH_MODE_REOPEN, BENCH_MODE_WRITEV};
+    if ( CaptureFile::ioSupported(CAPTURE_IO_MMAP) ) modes.append(BENCH_MODE_MMAP);
+    if ( CaptureFile::ioSupported(CAPTURE_IO_URING) ) modes.append(BENCH_MODE_URING);
+
+    // 不限速
+    const qint64 records = totalMb * 1000 * 1000 / recordBytes;
+    const qint64 bytes = records * recordBytes;
+    std::printf("unpaced: %lld records, %.1f MB, flush every %d bytes\n",
+        static_cast<long long>(records), bytes / 1e6, CACHING_BUFFER_MAX_BYTES);
+    for ( const auto mode : modes ) {
+        const BENCH_RESULT result = runMode(mode, filePath, records, header, payload, 0);
+        if ( !result.ok ) continue;
+        std::printf("  %-8s %10.1f MB/s  wall %7.3f s  cpu %7.3f s  max flush %7.2f ms\n",
+            modeName(mode), bytes / result.wallSec / 1e6, result.wallSec, result.cpuSec, result.maxFlushMs);
+    }
+
+    // 按链路速率限速
+    for ( const qint64 rate : {static_cast<qint64>(BENCH_RATE_1GBE), static_cast<qint64>(BENCH_RATE_10GBE)} ) {
+        const qint64 pacedRecords = rate * pacedSec / recordBytes;
+        std::printf("paced at %lld MB/s for %lld s:\n", static_cast<long long>(rate / 1000000), static_cast<long long>(pacedSec));
+        for ( const auto mode : modes ) {
+            const BENCH_RESULT result = runMode(mode, filePath, pacedRecords, header, payload, rate);
+            if ( !result.ok ) continue;
+            std::printf("  %-8s cpu %5.1f%%  max flush %7.2f ms  lag %6.3f s\n",
+                modeName(mode), 100 * result.cpuSec / result.wallSec, result.maxFlushMs, result.lagSec);
+        }
+    }
+
+    QFile::remove(filePath);
+    return 0;
+}
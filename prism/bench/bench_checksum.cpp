@@ -0,0 +1,144 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/19.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+// 有效校验和模式的开销
+// 用法: bench_checksum [每轮总量 MB, 默认 256] [输出目录, 默认系统临时目录] [轮数, 默认 5]
+//
+// kernel:  Checksum::partial 对 16 KB 数据的吞吐, 以及当前选用的实现
+// capture: PacketDumper 不开写线程, 同一线程内从 onPlainStream 交出 16 KB 明文块,
+//          经分段、记录链到写盘走完整条路径, 校验和关闭与开启交替运行, 取各自 CPU 时间的中位数
+// 输出开启后增加的 CPU 时间占比, 目标为不超过 CHECKSUM_TARGET_PERCENT
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+#include "checksum.h"
+#include "dump.h"
+#include "flow_registry.h"
+
+
+#define BENCH_CHUNK_BYTES           (16 * 1024)
+#define CHECKSUM_TARGET_PERCENT     5.0
+
+
+typedef struct BENCH_RESULT_ {
+    double      wallSec = 0;
+    double      cpuSec = 0;
+} BENCH_RESULT;
+
+
+static double median(std::vector<double> values) {
+
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0 : values[values.size() / 2];
+}
+
+static void benchKernel(const QByteArray &chunk) {
+
+    const int rounds = 200000;
+    uint64_t sink = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0; i < rounds; i++ ) {
+        sink += Checksum::partial(chunk.constData(), chunk.size(), i);
+    }
+    const double sec = timer.nsecsElapsed() / 1e9;
+
+    std::printf("kernel %s: %.0f ns per %d bytes, %.1f GB/s (%04x)\n",
+        Checksum::kernel(), sec * 1e9 / rounds, BENCH_CHUNK_BYTES,
+        static_cast<double>(chunk.size()) * rounds / sec / 1e9, Checksum::finish(sink));
+}
+
+// 一条 TCP 流下行 chunks 块, 每 8 块上行 1 块
+static BENCH_RESULT runCapture(const QString &filePath, const bool checksums, const qint64 chunks, const QByteArray &chunk) {
+
+    QFile::remove(filePath);
+
+    PacketDumper &dumper = PacketDumper::instance();
+    dumper.setPcapFilePath(filePath);
+    dumper.setCaptureFormat(CAPTURE_FORMAT_PCAP);
+    dumper.setChecksums(checksums);
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::clock_t cpu = std::clock();
+
+    dumper.start(false);
+    const auto flow = FlowRegistry::instance().open(true, 1, "10.0.0.2", 50000, "example.com", "93.184.216.34", 443);
+    dumper.onStreamConnectionMade(*flow);
+    for ( qint64 i = 0; i < chunks; i++ ) {
+        dumper.onPlainStream(*flow, chunk.constData(), chunk.size(), i % 8 == 7);
+    }
+    dumper.onStreamTeardown(*flow);
+    FlowRegistry::instance().close(true, 1);
+    dumper.stop();
+
+    const BENCH_RESULT result = {timer.nsecsElapsed() / 1e9, static_cast<double>(std::clock() - cpu) / CLOCKS_PER_SEC};
+    QFile::remove(filePath);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+    const QStringList args = QCoreApplication::arguments();
+
+    const qint64 totalMb = args.size() > 1 ? args.at(1).toLongLong() : 256;
+    const QString dir = args.size() > 2 ? args.at(2) : QDir::tempPath();
+    const int rounds = args.size() > 3 ? qMax(1, args.at(3).toInt()) : 5;
+    const QString filePath = QDir(dir).filePath(QStringLiteral("bench_checksum.pcap"));
+
+    QByteArray chunk(BENCH_CHUNK_BYTES, '\0');
+    for ( qsizetype i = 0; i < chunk.size(); i++ ) {
+        chunk[i] = static_cast<char>(i * 131 + 7);
+    }
+
+    benchKernel(chunk);
+
+    const qint64 chunks = totalMb * 1024 * 1024 / BENCH_CHUNK_BYTES;
+    std::vector<double> wall[2], cpu[2];
+    for ( int round = 0; round < rounds; round++ ) {
+        for ( const bool checksums : {false, true} ) {
+            const BENCH_RESULT result = runCapture(filePath, checksums, chunks, chunk);
+            wall[checksums].push_back(result.wallSec);
+            cpu[checksums].push_back(result.cpuSec);
+        }
+    }
+
+    const double bytes = static_cast<double>(chunks) * BENCH_CHUNK_BYTES;
+    for ( const bool checksums : {false, true} ) {
+        std::printf("capture checksums %-3s: %8.1f MB/s  cpu %.3f s  (median of %d)\n",
+            checksums ? "on" : "off", bytes / median(wall[checksums]) / 1e6, median(cpu[checksums]), rounds);
+    }
+
+    const double overhead = 100 * (median(cpu[true]) - median(cpu[false])) / median(cpu[false]);
+    std::printf("overhead %.1f%% of capture cpu, target < %.0f%%: %s\n",
+        overhead, CHECKSUM_TARGET_PERCENT, overhead < CHECKSUM_TARGET_PERCENT ? "met" : "not met");
+
+    return 0;
+}
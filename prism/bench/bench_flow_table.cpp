@@ -0,0 +1,146 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/19.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+// 流表查找
+// 用法: bench_flow_table [活动流数, 默认 100000] [查找次数, 默认 20000000]
+//
+// 同一串随机流 id (固定种子) 在以下流表上查找, 值均为指向流对象的共享指针:
+//   qstring-qmap:  旧的写法, 每次查找格式化 "TCP[n]" 作为键, 在 QMutex 保护的 QMap 中取出 QSharedPointer
+//   flat-mutex:    FLOW_KEY 为键的 FlatHashMap, QMutex 保护, 同 FlowRegistry 的加锁读取
+//   flat:          FLOW_KEY 为键的 FlatHashMap, 不加锁, 同写线程中的 PacketDumper::m_flows
+// 另外测量每种流表上一次关闭加一次新建的吞吐
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSharedPointer>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "capture_index.h"
+#include "custom/flat_map.hpp"
+#include "custom/object_pool.hpp"
+#include "custom/safe_map.hpp"
+
+
+typedef struct BENCH_FLOW_ : PoolCounted {
+    explicit BENCH_FLOW_(const int index) : index(index) {}
+    int         index;
+    qint64      bytes = 0;
+} BENCH_FLOW;
+
+
+// 改动前 MiscFuncs::genFlowKey 的键
+static QString genFlowKey(const bool isStream, const int index) {
+
+    return QStringLiteral("%1[%2]").arg(isStream ? "TCP" : "UDP").arg(index);
+}
+
+static void report(const char *name, const char *what, const qint64 ops, const qint64 ns, const qint64 check) {
+
+    std::printf("  %-14s %8.2f M %s/s  (%lld)\n", name, ops * 1e3 / ns, what, static_cast<long long>(check));
+}
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+    const QStringList args = QCoreApplication::arguments();
+
+    const int flows = args.size() > 1 ? qMax(1, args.at(1).toInt()) : 100000;
+    const qint64 lookups = args.size() > 2 ? qMax<qint64>(1, args.at(2).toLongLong()) : 20000000;
+    // 关闭加新建的次数
+    const int churn = flows;
+
+    std::mt19937 rng(20250819);
+    std::uniform_int_distribution<int> pick(0, flows - 1);
+    std::vector<int> order(1 << 20);
+    for ( auto &index : order ) index = pick(rng);
+    const size_t orderMask = order.size() - 1;
+
+    ThreadSafeMap<QString, QSharedPointer<BENCH_FLOW>> stringMap;
+    FlatHashMap<PoolPtr<BENCH_FLOW>> flatMap;
+    QMutex flatMutex;
+    for ( int i = 0; i < flows; i++ ) {
+        stringMap.set(genFlowKey(true, i), QSharedPointer<BENCH_FLOW>::create(i));
+        flatMap.set(FLOW_KEY(true, i), PoolPtr<BENCH_FLOW>::create(i));
+    }
+
+    std::printf("%d flows, %lld lookups\n", flows, static_cast<long long>(lookups));
+    QElapsedTimer timer;
+
+    // 查找
+    {
+        qint64 check = 0;
+        timer.start();
+        for ( qint64 i = 0; i < lookups; i++ ) {
+            const auto flow = stringMap.get(genFlowKey(true, order[i & orderMask]));
+            if ( flow ) check += (*flow)->index;
+        }
+        report("qstring-qmap", "lookups", lookups, timer.nsecsElapsed(), check);
+    }
+    {
+        qint64 check = 0;
+        timer.start();
+        for ( qint64 i = 0; i < lookups; i++ ) {
+            QMutexLocker locker(&flatMutex);
+            const auto *flow = flatMap.find(FLOW_KEY(true, order[i & orderMask]));
+            if ( flow ) check += (*flow)->index;
+        }
+        report("flat-mutex", "lookups", lookups, timer.nsecsElapsed(), check);
+    }
+    {
+        qint64 check = 0;
+        timer.start();
+        for ( qint64 i = 0; i < lookups; i++ ) {
+            const auto *flow = flatMap.find(FLOW_KEY(true, order[i & orderMask]));
+            if ( flow ) check += (*flow)->index;
+        }
+        report("flat", "lookups", lookups, timer.nsecsElapsed(), check);
+    }
+
+    // 连接更替: 关闭最早的流, 以新的 id 建立一个流, 活动流数不变
+    {
+        int next = flows;
+        timer.start();
+        for ( int i = 0; i < churn; i++ ) {
+            stringMap.remove(genFlowKey(true, next - flows));
+            stringMap.set(genFlowKey(true, next), QSharedPointer<BENCH_FLOW>::create(next));
+            next++;
+        }
+        report("qstring-qmap", "churn", churn, timer.nsecsElapsed(), stringMap.size());
+    }
+    {
+        int next = flows;
+        timer.start();
+        for ( int i = 0; i < churn; i++ ) {
+            QMutexLocker locker(&flatMutex);
+            flatMap.remove(FLOW_KEY(true, next - flows));
+            flatMap.set(FLOW_KEY(true, next), PoolPtr<BENCH_FLOW>::create(next));
+            next++;
+        }
+        report("flat-mutex", "churn", churn, timer.nsecsElapsed(), static_cast<qint64>(flatMap.size()));
+    }
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_CAPTURE_CLOCK_H
+#define PRISM_CAPTURE_CLOCK_H
+
+#include <QtGlobal>
+
+
+// 抓包时间源
+// 锚定时各取一次墙上时间与单调时钟, 之后的时间戳都由单调时钟推算, 纳秒精度且不会回退
+// 单调时钟为 std::chrono::steady_clock, Linux 上即 vDSO 中的 clock_gettime(CLOCK_MONOTONIC)
+class CaptureClock {
+
+public:
+    // 重新锚定墙上时间, 开始抓包时调用, 系统时间被调整后从下一次抓包开始生效
+    static void anchor();
+    // 纳秒 UTC, 任意线程调用
+    static qint64 nowNs();
+};
+
+
+#endif //PRISM_CAPTURE_CLOCK_H
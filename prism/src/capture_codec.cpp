@@ -0,0 +1,162 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "capture_codec.h"
+#include <array>
+
+#ifdef PRISM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+#define GZIP_MAGIC                  0x8b1fu
+#define ZSTD_MAGIC                  0xFD2FB528u
+
+
+static unsigned int crc32(const char *data, const qsizetype len) {
+
+    static const auto table = []() {
+        std::array<unsigned int, 256> result{};
+        for ( unsigned int i = 0; i < 256; i++ ) {
+            unsigned int c = i;
+            for ( int k = 0; k < 8; k++ ) {
+                c = (c & 1u) ? 0xEDB88320u ^ (c >> 1u) : c >> 1u;
+            }
+            result[i] = c;
+        }
+        return result;
+    }();
+
+    unsigned int crc = 0xFFFFFFFFu;
+    for ( qsizetype i = 0; i < len; i++ ) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFFu] ^ (crc >> 8u);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void appendLe32(QByteArray &out, const unsigned int value) {
+
+    const char bytes[4] = {
+        static_cast<char>(value & 0xFFu),
+        static_cast<char>((value >> 8u) & 0xFFu),
+        static_cast<char>((value >> 16u) & 0xFFu),
+        static_cast<char>((value >> 24u) & 0xFFu),
+    };
+    out.append(bytes, sizeof(bytes));
+}
+
+// qCompress 输出为 4 字节长度 + zlib 流 (2 字节头 + deflate + 4 字节 adler32)
+// 取出其中的 deflate 数据, 重新封装为 gzip member
+static QByteArray gzipCompress(const char *data, const qsizetype len) {
+
+    const QByteArray zlib = qCompress(reinterpret_cast<const uchar *>(data), len, GZIP_COMPRESS_LEVEL);
+    if ( zlib.size() < 4 + 2 + 4 ) {
+        return {};
+    }
+
+    const char *deflate = zlib.constData() + 4 + 2;
+    const qsizetype deflateLen = zlib.size() - 4 - 2 - 4;
+
+    static const char header[10] = {
+        '\x1f', '\x8b',                     // magic
+        '\x08',                             // CM = deflate
+        '\x00',                             // FLG
+        '\x00', '\x00', '\x00', '\x00',     // MTIME
+        '\x00',                             // XFL
+        '\xff',                             // OS = unknown
+    };
+
+    QByteArray result;
+    result.reserve(sizeof(header) + deflateLen + 8);
+    result.append(header, sizeof(header));
+    result.append(deflate, deflateLen);
+    appendLe32(result, crc32(data, len));
+    appendLe32(result, static_cast<unsigned int>(len));
+    return result;
+}
+
+#ifdef PRISM_WITH_ZSTD
+static QByteArray zstdCompress(const char *data, const qsizetype len) {
+
+    QByteArray result;
+    result.resize(static_cast<qsizetype>(ZSTD_compressBound(len)));
+
+    const size_t n = ZSTD_compress(result.data(), result.size(), data, len, ZSTD_COMPRESS_LEVEL);
+    if ( ZSTD_isError(n) ) {
+        return {};
+    }
+    result.resize(static_cast<qsizetype>(n));
+    return result;
+}
+#endif
+
+
+bool CaptureCodec::available(const CAPTURE_CODEC codec) {
+
+    switch ( codec ) {
+    case CAPTURE_CODEC_NONE:
+    case CAPTURE_CODEC_GZIP:
+        return true;
+    case CAPTURE_CODEC_ZSTD:
+#ifdef PRISM_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+QString CaptureCodec::suffix(const CAPTURE_CODEC codec) {
+
+    switch ( codec ) {
+    case CAPTURE_CODEC_GZIP: return QStringLiteral(".gz");
+    case CAPTURE_CODEC_ZSTD: return QStringLiteral(".zst");
+    default: break;
+    }
+    return {};
+}
+
+bool CaptureCodec::magicMatches(const CAPTURE_CODEC codec, const unsigned int magic) {
+
+    switch ( codec ) {
+    case CAPTURE_CODEC_GZIP: return (magic & 0xFFFFu) == GZIP_MAGIC;
+    case CAPTURE_CODEC_ZSTD: return magic == ZSTD_MAGIC;
+    default: break;
+    }
+    return false;
+}
+
+QByteArray CaptureCodec::compress(const CAPTURE_CODEC codec, const char *data, const qsizetype len) {
+
+    switch ( codec ) {
+    case CAPTURE_CODEC_GZIP:
+        return gzipCompress(data, len);
+#ifdef PRISM_WITH_ZSTD
+    case CAPTURE_CODEC_ZSTD:
+        return zstdCompress(data, len);
+#endif
+    default:
+        break;
+    }
+    return {};
+}
@@ -0,0 +1,56 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_CAPTURE_CODEC_H
+#define PRISM_CAPTURE_CODEC_H
+
+#include <QByteArray>
+#include <QString>
+
+
+// 抓包输出压缩方式
+// 每次写盘压缩为一个可独立解码的帧 (gzip member / zstd frame), 帧直接首尾拼接
+// 进程崩溃时最多丢失最后一个未写完的帧
+enum CAPTURE_CODEC {
+    CAPTURE_CODEC_NONE,
+    CAPTURE_CODEC_GZIP,             // Qt 自带 zlib
+    CAPTURE_CODEC_ZSTD,             // 需要以 PRISM_WITH_ZSTD 编译
+};
+
+#define GZIP_COMPRESS_LEVEL         6
+#define ZSTD_COMPRESS_LEVEL         3
+
+
+class CaptureCodec {
+
+public:
+    static bool available(CAPTURE_CODEC codec);
+    // 输出文件名后缀, 如 .gz
+    static QString suffix(CAPTURE_CODEC codec);
+    // 文件开头 4 字节是否为该压缩格式
+    static bool magicMatches(CAPTURE_CODEC codec, unsigned int magic);
+    // 压缩为一个完整的帧, 失败返回空
+    static QByteArray compress(CAPTURE_CODEC codec, const char *data, qsizetype len);
+};
+
+
+#endif //PRISM_CAPTURE_CODEC_H
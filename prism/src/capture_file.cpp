@@ -0,0 +1,603 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/13.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "capture_file.h"
+#include "dump.h"
+#include <QFileInfo>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#ifndef Q_OS_WIN
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <vector>
+#else
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX     1024
+#endif
+
+
+static unsigned int readMagic(const QString &filePath) {
+
+    unsigned int magic = 0;
+
+    QFile file(filePath);
+    if ( file.open(QIODevice::ReadOnly) ) {
+        if ( file.read(reinterpret_cast<char *>(&magic), sizeof(magic)) != sizeof(magic) ) {
+            magic = 0;
+        }
+    }
+    return magic;
+}
+
+// 未压缩 pcap 文件全局头中的链路层类型
+static unsigned int readPcapLinkType(const QString &filePath) {
+
+    PCAP_HDR capHdr = {};
+
+    QFile file(filePath);
+    if ( !file.open(QIODevice::ReadOnly) ||
+         file.read(reinterpret_cast<char *>(&capHdr), sizeof(capHdr)) != sizeof(capHdr) ) {
+        return 0;
+    }
+    return capHdr.network;
+}
+
+// 当前线程消耗的 CPU 时间, 微秒
+static unsigned long long threadCpuUs() {
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if ( !GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user) ) {
+        return 0;
+    }
+    const unsigned long long k = (static_cast<unsigned long long>(kernel.dwHighDateTime) << 32u) | kernel.dwLowDateTime;
+    const unsigned long long u = (static_cast<unsigned long long>(user.dwHighDateTime) << 32u) | user.dwLowDateTime;
+    return (k + u) / 10;
+#else
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+// mmap 模式预分配的窗口只在 close 时截断, 进程崩溃后文件末尾留有全零的部分, 追加前去掉
+// 崩溃留下的文件长度必为页对齐的窗口起点加一个完整窗口, 其余文件不检查; 末尾 4 字节为零也可能是正常报文
+// 满足长度条件且末尾为零时才从文件头按 pcap 记录或 pcapng 块走到最后一个完整的记录
+static void trimZeroTail(const QString &filePath, const CAPTURE_FORMAT format) {
+#ifdef Q_OS_LINUX
+    QFile file(filePath);
+    if ( !file.open(QIODevice::ReadOnly) ) return;
+
+    const qint64 size = file.size();
+    const qint64 page = sysconf(_SC_PAGESIZE);
+    if ( size < CAPTURE_MMAP_WINDOW || page <= 0 || size % page != 0 ) {
+        return;
+    }
+
+    uint32_t tail = 0;
+    if ( !file.seek(size - static_cast<qint64>(sizeof(tail))) ||
+         file.read(reinterpret_cast<char *>(&tail), sizeof(tail)) != sizeof(tail) || tail != 0 ) {
+        return;
+    }
+
+    const uchar *base = file.map(0, size);
+    if ( !base ) return;
+
+    qint64 end = 0;
+    if ( format == CAPTURE_FORMAT_PCAPNG ) {
+        // 块类型, 块长度 ... 块尾长度, 长度为 4 的倍数
+        while ( end + 12 <= size ) {
+            uint32_t type, len, lenTail;
+            memcpy(&type, base + end, sizeof(type));
+            memcpy(&len, base + end + 4, sizeof(len));
+            if ( type == 0 || len < 12 || len % 4 || len > size - end ) break;
+            memcpy(&lenTail, base + end + len - 4, sizeof(lenTail));
+            if ( lenTail != len ) break;
+            end += len;
+        }
+    } else {
+        end = sizeof(PCAP_HDR);
+        while ( end + static_cast<qint64>(sizeof(PCAPREC_HDR)) <= size ) {
+            PCAPREC_HDR rec;
+            memcpy(&rec, base + end, sizeof(rec));
+            if ( rec.ts_sec == 0 && rec.incl_len == 0 ) break;
+            if ( rec.incl_len > size - end - static_cast<qint64>(sizeof(rec)) ) break;
+            end += static_cast<qint64>(sizeof(rec)) + rec.incl_len;
+        }
+    }
+
+    file.unmap(const_cast<uchar *>(base));
+    file.close();
+    if ( end < size ) {
+        QFile::resize(filePath, end);
+    }
+#else
+    // 只有 Linux 下使用 mmap 模式
+    (void)filePath;
+    (void)format;
+#endif
+}
+
+static QByteArray buildPcapHeader(const CAPTURE_LINKTYPE linkType) {
+
+    PCAP_HDR capHdr = {};
+    capHdr.magic_number     = 0xa1b2c3d4;
+    capHdr.version_major    = 0x02;
+    capHdr.version_minor    = 0x04;
+    capHdr.thiszone         = 0;
+    capHdr.sigfigs          = 0;
+    capHdr.snaplen          = 0xA0000000;
+    capHdr.network          = linkType;
+
+    return {reinterpret_cast<const char *>(&capHdr), sizeof(capHdr)};
+}
+
+static QByteArray buildPcapngHeader(const CAPTURE_LINKTYPE linkType) {
+
+    PCAPNG_SHB shb = {};
+    shb.block_type              = PCAPNG_BT_SHB;
+    shb.block_total_length      = sizeof(shb);
+    shb.byte_order_magic        = PCAPNG_BYTE_ORDER_MAGIC;
+    shb.version_major           = 1;
+    shb.version_minor           = 0;
+    shb.section_length          = -1;
+    shb.block_total_length_tail = sizeof(shb);
+
+    PCAPNG_IDB idb = {};
+    idb.block_type              = PCAPNG_BT_IDB;
+    idb.block_total_length      = sizeof(idb);
+    idb.link_type               = linkType;
+    idb.snaplen                 = 0;
+    idb.tsresol_opt.code        = PCAPNG_OPT_IF_TSRESOL;
+    idb.tsresol_opt.length      = 1;
+    idb.tsresol                 = 9;
+    idb.end_opt.code            = PCAPNG_OPT_ENDOFOPT;
+    idb.end_opt.length          = 0;
+    idb.block_total_length_tail = sizeof(idb);
+
+    QByteArray result;
+    result.append(reinterpret_cast<const char *>(&shb), sizeof(shb));
+    result.append(reinterpret_cast<const char *>(&idb), sizeof(idb));
+    return result;
+}
+
+bool CaptureFile::open(const QString &filePath, const CAPTURE_FORMAT format, const CAPTURE_CODEC codec) {
+
+    this->close();
+    this->m_codec = codec;
+
+    const unsigned int magic = QFileInfo(filePath).size() > 0 ? readMagic(filePath) : 0;
+
+    // 不同格式不能混写在同一个文件里
+    bool matches = true;
+    if ( magic != 0 ) {
+        if ( codec != CAPTURE_CODEC_NONE ) {
+            matches = CaptureCodec::magicMatches(codec, magic);
+        } else {
+            matches = magic == (format == CAPTURE_FORMAT_PCAPNG ? PCAPNG_BT_SHB : 0xa1b2c3d4);
+            // pcap 整个文件只有一个链路层类型, pcapng 每个 section 有自己的 IDB
+            if ( matches && format == CAPTURE_FORMAT_PCAP ) {
+                matches = readPcapLinkType(filePath) == this->m_linkType;
+            }
+            if ( matches ) {
+                trimZeroTail(filePath, format);
+            }
+        }
+    }
+
+    // 压缩帧无法从文件头逐帧校验, 崩溃后留下的预分配零区无从识别, 因此压缩输出不使用 mmap
+    this->m_activeIo = codec != CAPTURE_CODEC_NONE && this->m_io == CAPTURE_IO_MMAP ? CAPTURE_IO_FILE : this->m_io;
+
+    // mmap 与 io_uring 以显式偏移写入, 不能带 O_APPEND
+    // MAP_SHARED 写映射需要读写打开, WriteOnly 单独使用时 Qt 会截断文件, 因此同样读写打开
+    QIODevice::OpenMode mode = QIODevice::Unbuffered;
+    if ( this->m_activeIo != CAPTURE_IO_FILE ) {
+        mode |= QIODevice::ReadWrite;
+        if ( !matches ) mode |= QIODevice::Truncate;
+    } else {
+        mode |= QIODevice::WriteOnly;
+        mode |= matches ? QIODevice::Append : QIODevice::Truncate;
+    }
+
+    this->m_file.setFileName(filePath);
+    if ( !this->m_file.open(mode) ) {
+        return false;
+    }
+    this->m_fileEnd = this->m_file.size();
+    // pcap 的全局头只在文件开头, pcapng 的每个 section 从追加处开始
+    this->m_appended = this->m_fileEnd > 0;
+    this->m_sectionOffset = format == CAPTURE_FORMAT_PCAPNG ? this->m_fileEnd : 0;
+
+    if ( this->m_activeIo == CAPTURE_IO_URING && !this->m_uring.setup(this->m_file.handle(), this->m_syncEachFlush) ) {
+        // 内核不支持 io_uring, 退回普通写, 从文件末尾继续
+        this->m_activeIo = CAPTURE_IO_FILE;
+        this->m_file.seek(this->m_fileEnd);
+    }
+    this->m_boundaries = {this->m_fileEnd};
+    const qint64 openedAt = this->m_fileEnd;
+
+    QByteArray header;
+    if ( format == CAPTURE_FORMAT_PCAPNG ) {
+        header = buildPcapngHeader(this->m_linkType);
+    } else if ( this->m_fileEnd == 0 ) {
+        header = buildPcapHeader(this->m_linkType);
+    }
+
+    if ( !header.isEmpty() ) {
+        const bool result = codec == CAPTURE_CODEC_NONE ?
+                            this->writeAll(header.constData(), header.size()) :
+                            this->writeCompressed(header.constData(), header.size());
+        if ( !result || (this->m_activeIo == CAPTURE_IO_URING && !this->m_uring.submit()) ) {
+            this->discardOpen(filePath, openedAt);
+            return false;
+        }
+        if ( this->m_activeIo == CAPTURE_IO_URING ) {
+            this->m_boundaries.append(this->m_fileEnd);
+        }
+    }
+
+    return true;
+}
+
+void CaptureFile::close() {
+
+    if ( this->m_file.isOpen() ) {
+        if ( this->m_activeIo == CAPTURE_IO_MMAP ) {
+            this->unmapWindow();
+            // 去掉预分配但未写入的部分
+            this->m_file.resize(this->m_fileEnd);
+        } else if ( this->m_activeIo == CAPTURE_IO_URING ) {
+            this->finishUring();
+        }
+        this->m_file.close();
+    }
+}
+
+qint64 CaptureFile::size() const {
+
+    return this->m_fileEnd;
+}
+
+qint64 CaptureFile::durableSize() const {
+
+    if ( this->m_activeIo == CAPTURE_IO_URING ) {
+        const qint64 pending = this->m_uring.pendingFrom();
+        if ( pending >= 0 ) return pending;
+    }
+    return this->size();
+}
+
+qint64 CaptureFile::takeLostBytes() {
+
+    const qint64 lost = this->m_lostBytes;
+    this->m_lostBytes = 0;
+    return lost;
+}
+
+// 等待在途的写请求全部完成后释放 io_uring
+// 有写请求失败时文件截断到失败处之前最后一次完整写盘的末尾, 不留空洞与半条记录
+void CaptureFile::finishUring() {
+
+    this->m_uring.teardown();
+    this->m_ioErrors += this->m_uring.failures();
+
+    const qint64 failedAt = this->m_uring.failedAt();
+    if ( failedAt >= 0 && !this->m_boundaries.isEmpty() ) {
+        qint64 end = this->m_boundaries.first();
+        for ( const qint64 boundary : this->m_boundaries ) {
+            if ( boundary > failedAt ) break;
+            end = boundary;
+        }
+        // 最后一次完整写盘之后拷贝进缓冲区的部分仍在调用方的链中, 不算丢失
+        this->m_lostBytes += qMax<qint64>(0, this->m_boundaries.last() - end);
+        this->m_file.resize(end);
+        this->m_fileEnd = end;
+    }
+    this->m_boundaries.clear();
+}
+
+// 文件头没能写完时关闭, 新建的文件删除, 追加的文件恢复到打开时的长度
+void CaptureFile::discardOpen(const QString &filePath, const qint64 openedAt) {
+
+    this->close();
+    if ( openedAt == 0 ) {
+        QFile::remove(filePath);
+    } else {
+        QFile::resize(filePath, openedAt);
+    }
+    this->m_fileEnd = openedAt;
+    // 截掉的只有文件头, 不是记录
+    this->m_lostBytes = 0;
+}
+
+bool CaptureFile::ioSupported(const CAPTURE_IO io) {
+
+    switch ( io ) {
+    case CAPTURE_IO_FILE:
+        return true;
+    case CAPTURE_IO_MMAP:
+#ifdef Q_OS_LINUX
+        return true;
+#else
+        return false;
+#endif
+    case CAPTURE_IO_URING:
+        return UringWriter::supported();
+    }
+    return false;
+}
+
+void CaptureFile::setIo(const CAPTURE_IO io, const bool syncEachFlush) {
+
+    Q_ASSERT(!this->m_file.isOpen());
+    this->m_io = ioSupported(io) ? io : CAPTURE_IO_FILE;
+    this->m_syncEachFlush = syncEachFlush;
+}
+
+void CaptureFile::unmapWindow() {
+#ifdef Q_OS_LINUX
+    if ( this->m_mapBase ) {
+        munmap(this->m_mapBase, this->m_mapLen);
+        this->m_mapBase = nullptr;
+        this->m_mapLen = 0;
+    }
+#endif
+}
+
+// 从当前写入位置所在的页开始, 预分配并映射下一个窗口
+bool CaptureFile::remapWindow() {
+#ifdef Q_OS_LINUX
+    this->unmapWindow();
+
+    const int fd = this->m_file.handle();
+    const qint64 page = sysconf(_SC_PAGESIZE);
+    const qint64 offset = this->m_fileEnd / page * page;
+
+    // 空间必须真正分配, 否则磁盘写满时访问映射会触发 SIGBUS
+    // 文件系统不支持 fallocate 时由 posix_fallocate 逐块写零
+    if ( fallocate(fd, 0, offset, CAPTURE_MMAP_WINDOW) != 0 ) {
+        if ( errno != EOPNOTSUPP || posix_fallocate(fd, offset, CAPTURE_MMAP_WINDOW) != 0 ) {
+            return false;
+        }
+    }
+
+    void *base = mmap(nullptr, CAPTURE_MMAP_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if ( base == MAP_FAILED ) {
+        return false;
+    }
+
+    this->m_mapBase = static_cast<char *>(base);
+    this->m_mapOffset = offset;
+    this->m_mapLen = CAPTURE_MMAP_WINDOW;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// 返回实际拷贝的字节数, 只在需要新窗口而映射失败时少于 len
+qsizetype CaptureFile::writeMapped(const char *data, const qsizetype len) {
+
+    qsizetype done = 0;
+    while ( done < len ) {
+        if ( !this->m_mapBase || this->m_fileEnd >= this->m_mapOffset + this->m_mapLen ) {
+            if ( !this->remapWindow() ) {
+                break;
+            }
+        }
+
+        const qsizetype pos = this->m_fileEnd - this->m_mapOffset;
+        const qsizetype n = qMin(len - done, this->m_mapLen - pos);
+        memcpy(this->m_mapBase + pos, data + done, n);
+
+        this->m_fileEnd += n;
+        done += n;
+    }
+    return done;
+}
+
+void CaptureFile::resetStats() {
+
+    this->m_rawBytes = 0;
+    this->m_codecBytes = 0;
+    this->m_codecCpuUs = 0;
+    this->m_ioErrors = 0;
+}
+
+bool CaptureFile::writeAll(const char *data, qsizetype len) {
+
+    if ( this->m_activeIo == CAPTURE_IO_MMAP ) {
+        return this->writeMapped(data, len) == len;
+    }
+    if ( this->m_activeIo == CAPTURE_IO_URING ) {
+        if ( !this->m_uring.write(this->m_fileEnd, data, len) ) {
+            return false;
+        }
+        this->m_fileEnd += len;
+        return true;
+    }
+
+    while ( len > 0 ) {
+        const auto written = this->m_file.write(data, len);
+        if ( written <= 0 ) {
+            return false;
+        }
+        this->m_fileEnd += written;
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+bool CaptureFile::writeCompressed(const char *data, const qsizetype len) {
+
+    const unsigned long long begin = threadCpuUs();
+    const QByteArray frame = CaptureCodec::compress(this->m_codec, data, len);
+    this->m_codecCpuUs += threadCpuUs() - begin;
+
+    if ( frame.isEmpty() ) {
+        return false;
+    }
+
+    this->m_rawBytes += len;
+    this->m_codecBytes += frame.size();
+
+    return this->writeAll(frame.constData(), frame.size());
+}
+
+// 整条链拷贝进固定缓冲区后提交, 完成情况在之后的写入中回收
+// 任何一步失败都不动记录链, 返回 false
+bool CaptureFile::writeUring(RecordChain &chain) {
+
+    bool result = true;
+    if ( this->m_codec != CAPTURE_CODEC_NONE ) {
+        this->m_block.resize(0);
+        chain.appendTo(this->m_block);
+        result = this->writeCompressed(this->m_block.constData(), this->m_block.size());
+    } else {
+        for ( qsizetype i = 0; i < chain.segmentCount() && result; i++ ) {
+            result = this->writeAll(chain.segmentData(i), chain.segmentSize(i));
+        }
+    }
+    if ( !result || !this->m_uring.submit() ) {
+        return false;
+    }
+    chain.clear();
+
+    this->m_boundaries.append(this->m_fileEnd);
+    const qint64 durable = this->durableSize();
+    while ( this->m_boundaries.size() > 1 && this->m_boundaries.at(1) <= durable ) {
+        this->m_boundaries.removeFirst();
+    }
+    return true;
+}
+
+bool CaptureFile::write(RecordChain &chain) {
+
+    if ( !this->m_file.isOpen() ) {
+        return false;
+    }
+
+    if ( this->m_activeIo == CAPTURE_IO_URING ) {
+        if ( this->writeUring(chain) ) {
+            return true;
+        }
+        // 写请求失败后不再向空洞之后追加: 截断到最后一次完整写盘的末尾, 本文件余下部分与这条链改用普通写
+        this->finishUring();
+        this->m_activeIo = CAPTURE_IO_FILE;
+        this->m_file.seek(this->m_fileEnd);
+    }
+
+    if ( this->m_codec != CAPTURE_CODEC_NONE ) {
+        this->m_block.resize(0);
+        chain.appendTo(this->m_block);
+
+        // 帧只写出一部分时无法补救, 失败时记录链原样留给调用方计数后丢弃, 不能重试以免下一帧重复
+        if ( !this->writeCompressed(this->m_block.constData(), this->m_block.size()) ) {
+            this->m_ioErrors++;
+            return false;
+        }
+        chain.clear();
+        return true;
+    }
+
+    if ( this->m_activeIo == CAPTURE_IO_MMAP ) {
+        while ( !chain.isEmpty() ) {
+            const qsizetype len = chain.segmentSize(0);
+            const qsizetype written = this->writeMapped(chain.segmentData(0), len);
+            chain.consume(written);
+            if ( written != len ) {
+                this->m_ioErrors++;
+                return false;
+            }
+        }
+        return true;
+    }
+
+#ifdef Q_OS_WIN
+    while ( !chain.isEmpty() ) {
+        const auto written = this->m_file.write(chain.segmentData(0), chain.segmentSize(0));
+        if ( written <= 0 ) {
+            this->m_ioErrors++;
+            return false;
+        }
+        this->m_fileEnd += written;
+        chain.consume(written);
+    }
+    return true;
+#else
+    const int fd = this->m_file.handle();
+
+    std::vector<iovec> iov;
+    iov.reserve(chain.segmentCount());
+    for ( qsizetype i = 0; i < chain.segmentCount(); i++ ) {
+        iov.push_back({const_cast<char *>(chain.segmentData(i)), static_cast<size_t>(chain.segmentSize(i))});
+    }
+
+    size_t index = 0;
+    qsizetype written = 0;
+
+    bool result = true;
+    while ( index < iov.size() ) {
+        const int count = static_cast<int>(qMin<size_t>(iov.size() - index, IOV_MAX));
+        const ssize_t n = ::writev(fd, &iov[index], count);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue;
+            this->m_ioErrors++;
+            result = false;
+            break;
+        }
+        written += n;
+
+        auto left = static_cast<size_t>(n);
+        while ( left > 0 ) {
+            auto &vec = iov[index];
+            if ( left >= vec.iov_len ) {
+                left -= vec.iov_len;
+                index++;
+            } else {
+                vec.iov_base = static_cast<char *>(vec.iov_base) + left;
+                vec.iov_len -= left;
+                left = 0;
+            }
+        }
+    }
+
+    // 失败时未写出的部分留在链中, 下次再试
+    this->m_fileEnd += written;
+    chain.consume(written);
+    return result;
+#endif
+}
@@ -0,0 +1,154 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/13.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_CAPTURE_FILE_H
+#define PRISM_CAPTURE_FILE_H
+
+#include <QFile>
+#include <QList>
+#include <atomic>
+#include "record_chain.h"
+#include "capture_codec.h"
+#include "uring_writer.h"
+
+
+// mmap 模式下每次映射与预分配的窗口大小
+#define CAPTURE_MMAP_WINDOW         (64 * 1024 * 1024)
+
+
+// 写文件方式
+enum CAPTURE_IO {
+    CAPTURE_IO_FILE,                // QFile / writev
+    CAPTURE_IO_MMAP,                // fallocate + mmap, 仅 Linux
+    CAPTURE_IO_URING,               // io_uring 异步提交, 仅 Linux, 内核不支持时退回 FILE
+};
+
+
+// pcap/pcapng 的链路层类型
+enum CAPTURE_LINKTYPE {
+    CAPTURE_LINKTYPE_ETHERNET   = 1,        // 报文前带合成的以太网头
+    CAPTURE_LINKTYPE_RAW        = 101,      // 报文直接从 IP 头开始, 按版本号区分 IPv4/IPv6
+};
+
+
+// 抓包输出格式
+enum CAPTURE_FORMAT {
+    CAPTURE_FORMAT_PCAP,            // libpcap, 微秒时间戳
+    CAPTURE_FORMAT_PCAPNG,          // pcapng, 纳秒时间戳, 带域名解析与注释
+    CAPTURE_FORMAT_RAW,             // 不合成报文, 每个流的明文写入独立文件, 见 StreamDumper
+};
+
+
+// 抓包输出文件
+// 整个抓包期间只打开一次
+// pcap: 文件为空时写入一次全局头; pcapng: 每次打开追加一个新的 section
+// 已有文件与所选格式不一致时清空重写
+// 启用压缩时全局头与每次写出的记录各自压缩为一个独立的帧
+// Linux 下可选 mmap 模式: fallocate 预分配并按窗口映射, 写出为内存拷贝, 关闭时截断到实际长度
+// 崩溃后留下的零填充部分在下次追加前按记录边界去掉, 只检查长度为页对齐整窗口末尾的文件; 压缩输出无法按帧校验, 不使用 mmap
+// Linux 下可选 io_uring 模式: 写请求异步提交, 写盘调用不再阻塞在系统调用上
+// io_uring 写请求失败后截断到失败处之前最后一次完整写盘的末尾, 本文件余下部分改用普通写
+class CaptureFile {
+
+public:
+    CaptureFile() = default;
+    ~CaptureFile() { this->close(); }
+
+    CaptureFile(const CaptureFile&) = delete;
+    CaptureFile& operator=(const CaptureFile&) = delete;
+
+    bool open(const QString &filePath, CAPTURE_FORMAT format, CAPTURE_CODEC codec = CAPTURE_CODEC_NONE);
+    void close();
+    bool isOpen() const { return this->m_file.isOpen(); }
+    // 打开时取一次文件长度, 之后按写出的字节累计, 关闭后保持最后的长度
+    qint64 size() const;
+    // 本次打开是否追加到已有内容之后, 以及本次的文件头 (pcap 全局头或 pcapng SHB) 所在偏移
+    bool appended() const { return this->m_appended; }
+    qint64 sectionOffset() const { return this->m_sectionOffset; }
+
+    // 下次 open 时生效, 不支持的方式退回 CAPTURE_IO_FILE
+    // syncEachFlush 只对 io_uring 有效: 每次写盘后追加一个异步 fdatasync
+    void setIo(CAPTURE_IO io, bool syncEachFlush = false);
+    static bool ioSupported(CAPTURE_IO io);
+    // 下次 open 时生效; 已有的 pcap 文件链路层类型不同时清空重写
+    void setLinkType(const CAPTURE_LINKTYPE linkType) { this->m_linkType = linkType; }
+
+    // 一次 writev 写出整条记录链, 已写出的部分从链中移除
+    // 压缩模式下整条链压缩为一帧后写出, 失败时链不变, 由调用方丢弃
+    bool write(RecordChain &chain);
+
+    // io_uring 模式下在途的部分不计, 之前的内容不会再因写盘失败被截掉
+    qint64 durableSize() const;
+    // 写盘失败后截掉的已写出字节数, 取走后清零, 截断后的 size() 即为截断处
+    qint64 takeLostBytes();
+    // 失败的写盘次数与写请求数, 任意线程读取
+    unsigned long long ioErrors() const { return this->m_ioErrors; }
+
+    // 压缩统计, 任意线程读取; resetStats 同时清零 ioErrors
+    unsigned long long rawBytes() const { return this->m_rawBytes; }
+    unsigned long long codecBytes() const { return this->m_codecBytes; }
+    unsigned long long codecCpuUs() const { return this->m_codecCpuUs; }
+    void resetStats();
+
+private:
+    void discardOpen(const QString &filePath, qint64 openedAt);
+    bool writeUring(RecordChain &chain);
+    void finishUring();
+    bool writeAll(const char *data, qsizetype len);
+    bool writeCompressed(const char *data, qsizetype len);
+    qsizetype writeMapped(const char *data, qsizetype len);
+    bool remapWindow();
+    void unmapWindow();
+
+    QFile m_file{};
+    CAPTURE_CODEC m_codec{CAPTURE_CODEC_NONE};
+    bool m_appended{false};
+    qint64 m_sectionOffset{0};
+    // 压缩前拼接记录链的缓冲, 复用容量
+    QByteArray m_block{};
+
+    CAPTURE_IO m_io{CAPTURE_IO_FILE};
+    CAPTURE_LINKTYPE m_linkType{CAPTURE_LINKTYPE_ETHERNET};
+    // 实际使用的方式, io_uring 不可用时为 FILE
+    CAPTURE_IO m_activeIo{CAPTURE_IO_FILE};
+    bool m_syncEachFlush{false};
+
+    // io_uring 模式
+    UringWriter m_uring{};
+    // 每次完整写盘后的文件长度, 只保留最后一个已确认写完的及之后的
+    QList<qint64> m_boundaries{};
+    qint64 m_lostBytes{0};
+    std::atomic<unsigned long long> m_ioErrors{0};
+
+    // mmap 模式
+    char *m_mapBase{nullptr};
+    qint64 m_mapOffset{0};          // 窗口在文件中的起始偏移, 页对齐
+    qint64 m_mapLen{0};
+    qint64 m_fileEnd{0};            // 实际写入的长度, 各种方式都随写入累计, size() 不再查询文件
+
+    std::atomic<unsigned long long> m_rawBytes{0};
+    std::atomic<unsigned long long> m_codecBytes{0};
+    std::atomic<unsigned long long> m_codecCpuUs{0};
+};
+
+
+#endif //PRISM_CAPTURE_FILE_H
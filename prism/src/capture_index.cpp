@@ -0,0 +1,301 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "capture_index.h"
+#include "dump.h"
+#include <cstring>
+
+
+static QByteArray packEntry(const CAPTURE_INDEX_TYPE type, const void *body, const qsizetype len, const QByteArray &extra) {
+
+    const CAPTURE_INDEX_ENTRY entry = {static_cast<uint32_t>(type), static_cast<uint32_t>(len + extra.size())};
+
+    QByteArray out;
+    out.reserve(sizeof(entry) + len + extra.size());
+    out.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    out.append(static_cast<const char *>(body), len);
+    out.append(extra);
+    return out;
+}
+
+// 已有索引文件的头与本次抓包一致时才能追加
+static bool headerMatches(const QString &filePath, const CAPTURE_FORMAT format) {
+
+    CAPTURE_INDEX_HDR hdr = {};
+
+    QFile file(filePath);
+    if ( !file.open(QIODevice::ReadOnly) ||
+         file.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)) != sizeof(hdr) ) {
+        return false;
+    }
+    return memcmp(hdr.magic, CAPTURE_INDEX_MAGIC, sizeof(hdr.magic)) == 0 &&
+           hdr.version == CAPTURE_INDEX_VERSION &&
+           hdr.format == static_cast<uint32_t>(format);
+}
+
+bool CaptureIndex::open(const QString &capturePath, const CAPTURE_FORMAT format, const qint64 sectionOffset, const bool append) {
+
+    this->close();
+    if ( !this->m_enabled ) {
+        return false;
+    }
+
+    const QString filePath = indexPath(capturePath);
+    const bool matches = append && headerMatches(filePath, format);
+
+    this->m_file.setFileName(filePath);
+    if ( !this->m_file.open(QIODevice::WriteOnly | (matches ? QIODevice::Append : QIODevice::Truncate)) ) {
+        // 打不开时本次抓包不再生成索引
+        this->m_enabled = false;
+        this->m_buffer.clear();
+        this->m_pending.clear();
+        return false;
+    }
+
+    // 文件头与段条目排在打开之前已登记的流前面
+    QByteArray head;
+    if ( !matches ) {
+        CAPTURE_INDEX_HDR hdr = {};
+        memcpy(hdr.magic, CAPTURE_INDEX_MAGIC, sizeof(hdr.magic));
+        hdr.version = CAPTURE_INDEX_VERSION;
+        hdr.format = format;
+        head.append(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    }
+    const CAPTURE_INDEX_SECTION_BODY section = {static_cast<uint64_t>(sectionOffset)};
+    head.append(packEntry(CAPTURE_INDEX_SECTION, &section, sizeof(section), QByteArray()));
+    this->m_buffer.prepend(head);
+
+    this->m_nextTimeMark = sectionOffset;
+    this->m_indexSize = this->m_file.size();
+    this->flush();
+    this->m_checkpoints = {{sectionOffset, this->m_indexSize}};
+    return true;
+}
+
+void CaptureIndex::setEnabled(const bool enable) {
+
+    this->m_enabled = enable;
+    this->m_buffer.clear();
+    this->m_pending.clear();
+    this->m_run = RUN();
+    this->m_spans.clear();
+}
+
+// 还没打开文件时登记的流留在缓冲中, 打开后写在段条目之后
+void CaptureIndex::close() {
+
+    if ( this->m_file.isOpen() ) {
+        // 记录都已写出后才结束的流, 结束条目还在等下一次写盘
+        this->commit(0, 0);
+        this->m_file.close();
+    }
+    this->m_spans.clear();
+    this->m_checkpoints.clear();
+}
+
+void CaptureIndex::describeFlow(const FLOW_TRACK_ &flow, const qint64 tsNs) {
+
+    if ( !this->m_enabled ) return;
+
+    CAPTURE_INDEX_FLOW_BODY body = {};
+    body.key        = flow.key;
+    body.protocol   = flow.protocol;
+    body.family     = flow.isIpv6 ? 6 : 4;
+    body.src_port   = flow.src.hostPort();
+    body.dst_port   = flow.dst.hostPort();
+    body.ts         = tsNs;
+
+    const QByteArray domain = flow.domain.left(0xffff);
+    body.domain_len = domain.size();
+
+    // IPv4 只有前 4 字节有效, 其余为 0
+    memcpy(body.src_ip, flow.src.ip, sizeof(body.src_ip));
+    memcpy(body.dst_ip, flow.dst.ip, sizeof(body.dst_ip));
+
+    this->appendEntry(CAPTURE_INDEX_FLOW, &body, sizeof(body), domain);
+}
+
+void CaptureIndex::endFlow(const qint64 key, const qsizetype chainOffset) {
+
+    if ( !this->m_enabled ) return;
+    this->m_pending.append({key, chainOffset, -1, 0});
+}
+
+void CaptureIndex::addRecord(const qint64 key, const qsizetype chainOffset, const qsizetype len, const qint64 tsNs) {
+
+    if ( !this->m_enabled ) return;
+    this->m_pending.append({key, chainOffset, len, tsNs});
+}
+
+void CaptureIndex::commit(const qint64 fileOffset, const qsizetype written) {
+
+    if ( !this->m_enabled ) return;
+
+    qsizetype done = 0;
+    for ( ; done < this->m_pending.size(); done++ ) {
+        const PENDING &pending = this->m_pending.at(done);
+
+        if ( pending.len < 0 ) {
+            if ( pending.offset > written ) break;
+
+            // 流的最后一个区间先于结束条目
+            if ( this->m_run.key == pending.key ) this->closeRun();
+            const SPAN span = this->m_spans.take(pending.key);
+            const CAPTURE_INDEX_FLOW_END_BODY body = {
+                static_cast<uint64_t>(pending.key), span.firstTs, span.lastTs, static_cast<uint64_t>(span.records)
+            };
+            this->appendEntry(CAPTURE_INDEX_FLOW_END, &body, sizeof(body));
+            continue;
+        }
+
+        // 只写出一部分的记录等下次
+        if ( pending.offset + pending.len > written ) break;
+
+        const qint64 offset = fileOffset + pending.offset;
+        if ( this->m_run.key != pending.key || this->m_run.offset + this->m_run.length != offset ) {
+            this->closeRun();
+            this->m_run.key = pending.key;
+            this->m_run.offset = offset;
+        }
+        this->m_run.length += pending.len;
+        this->m_run.records++;
+
+        SPAN &span = this->m_spans[pending.key];
+        span.records++;
+
+        if ( pending.tsNs ) {
+            if ( !this->m_run.firstTs ) this->m_run.firstTs = pending.tsNs;
+            this->m_run.lastTs = pending.tsNs;
+            if ( !span.firstTs ) span.firstTs = pending.tsNs;
+            span.lastTs = pending.tsNs;
+
+            if ( offset >= this->m_nextTimeMark ) {
+                const CAPTURE_INDEX_TIME_BODY body = {pending.tsNs, static_cast<uint64_t>(offset)};
+                this->appendEntry(CAPTURE_INDEX_TIME, &body, sizeof(body));
+                this->m_nextTimeMark = offset + CAPTURE_INDEX_TIME_STEP;
+            }
+        }
+    }
+
+    this->m_pending.remove(0, done);
+    for ( auto &pending : this->m_pending ) {
+        pending.offset -= written;
+    }
+
+    // 每次写盘后索引覆盖全部已写出的记录
+    this->closeRun();
+    this->flush();
+    if ( written > 0 && this->m_file.isOpen() ) {
+        this->m_checkpoints.append({fileOffset + written, this->m_indexSize});
+    }
+}
+
+void CaptureIndex::dropPending(const qsizetype records, const qsizetype bytes) {
+
+    if ( !this->m_enabled || records <= 0 ) return;
+
+    QList<PENDING> kept;
+    kept.reserve(this->m_pending.size());
+
+    qsizetype dropped = 0;
+    qsizetype dropStart = -1;
+    for ( auto pending : this->m_pending ) {
+        if ( pending.offset < 0 ) {
+            // 已写出一部分的首条记录
+        } else if ( dropped < records ) {
+            if ( dropStart < 0 ) dropStart = pending.offset;
+            if ( pending.len >= 0 ) {
+                dropped++;
+                continue;
+            }
+            // 丢弃范围内结束的流, 结束条目移到丢弃处
+            pending.offset = dropStart;
+        } else {
+            pending.offset -= bytes;
+        }
+        kept.append(pending);
+    }
+
+    this->m_pending = std::move(kept);
+}
+
+void CaptureIndex::discardPending() {
+
+    this->m_pending.clear();
+}
+
+void CaptureIndex::rollback(const qint64 fileOffset) {
+
+    if ( !this->m_enabled || !this->m_file.isOpen() || this->m_checkpoints.isEmpty() ) return;
+
+    qsizetype keep = 0;
+    while ( keep + 1 < this->m_checkpoints.size() && this->m_checkpoints.at(keep + 1).fileOffset <= fileOffset ) {
+        keep++;
+    }
+    const CHECKPOINT &checkpoint = this->m_checkpoints.at(keep);
+
+    // 还没写到索引文件的条目属于之后的记录, 保留
+    this->m_file.resize(checkpoint.indexSize);
+    this->m_indexSize = checkpoint.indexSize;
+    this->m_nextTimeMark = qMin(this->m_nextTimeMark, checkpoint.fileOffset);
+    this->m_checkpoints.resize(keep + 1);
+}
+
+void CaptureIndex::settle(const qint64 fileOffset) {
+
+    while ( this->m_checkpoints.size() > 1 && this->m_checkpoints.at(1).fileOffset <= fileOffset ) {
+        this->m_checkpoints.removeFirst();
+    }
+}
+
+void CaptureIndex::appendEntry(const CAPTURE_INDEX_TYPE type, const void *body, const qsizetype len, const QByteArray &extra) {
+
+    this->m_buffer.append(packEntry(type, body, len, extra));
+}
+
+void CaptureIndex::closeRun() {
+
+    if ( this->m_run.records ) {
+        const CAPTURE_INDEX_RANGE_BODY body = {
+            static_cast<uint64_t>(this->m_run.key),
+            static_cast<uint64_t>(this->m_run.offset),
+            static_cast<uint64_t>(this->m_run.length),
+            this->m_run.firstTs,
+            this->m_run.lastTs,
+            this->m_run.records,
+            0
+        };
+        this->appendEntry(CAPTURE_INDEX_RANGE, &body, sizeof(body));
+    }
+    this->m_run = RUN();
+}
+
+void CaptureIndex::flush() {
+
+    if ( !this->m_file.isOpen() || this->m_buffer.isEmpty() ) {
+        return;
+    }
+    this->m_file.write(this->m_buffer);
+    this->m_file.flush();
+    this->m_indexSize += this->m_buffer.size();
+    this->m_buffer.clear();
+}
@@ -0,0 +1,204 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_CAPTURE_INDEX_H
+#define PRISM_CAPTURE_INDEX_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include "capture_file.h"
+
+
+// 索引文件名为抓包文件名加该后缀
+#define CAPTURE_INDEX_SUFFIX        ".idx"
+#define CAPTURE_INDEX_MAGIC         "PRSMIDX1"
+#define CAPTURE_INDEX_VERSION       1
+// 抓包文件每增长这么多字节记录一个 时间 -> 偏移 点
+#define CAPTURE_INDEX_TIME_STEP     (4 * 1024 * 1024)
+
+// 协议与流 id 组成的流键, 用于闸门表, 记录链中的记录归属与索引条目
+#define FLOW_KEY(isStream, index)           ((static_cast<qint64>(isStream) << 32) | static_cast<quint32>(index))
+
+
+// 索引条目类型
+enum CAPTURE_INDEX_TYPE {
+    CAPTURE_INDEX_SECTION   = 1,    // 抓包文件每次打开写一条, 之后的流 key 只在本段内唯一
+    CAPTURE_INDEX_FLOW      = 2,    // 流的五元组与域名, 流建立或轮转到新文件时写一条
+    CAPTURE_INDEX_RANGE     = 3,    // 流的一段连续记录在抓包文件中的位置
+    CAPTURE_INDEX_TIME      = 4,    // 稀疏的 时间 -> 偏移 点
+    CAPTURE_INDEX_FLOW_END  = 5,    // 流结束, 本文件内的首末时间与记录数
+};
+
+
+// 索引文件为文件头之后的一串条目, 每个条目为 CAPTURE_INDEX_ENTRY 加上对应类型的内容
+// 数值均为主机字节序, 偏移为抓包文件中的绝对偏移, 时间戳为纳秒 UTC
+#pragma pack(push)
+#pragma pack(1)
+
+typedef struct CAPTURE_INDEX_HDR_ {
+    char                magic[8];           // CAPTURE_INDEX_MAGIC
+    uint32_t            version;            // CAPTURE_INDEX_VERSION
+    uint32_t            format;             // 见 CAPTURE_FORMAT
+} CAPTURE_INDEX_HDR;
+
+typedef struct CAPTURE_INDEX_ENTRY_ {
+    uint32_t            type;               // 见 CAPTURE_INDEX_TYPE
+    uint32_t            length;             // 之后内容的长度
+} CAPTURE_INDEX_ENTRY;
+
+typedef struct CAPTURE_INDEX_SECTION_ {
+    uint64_t            offset;             // 本段在抓包文件中的起始偏移
+} CAPTURE_INDEX_SECTION_BODY;
+
+// 之后紧跟 domain_len 字节的域名
+typedef struct CAPTURE_INDEX_FLOW_ {
+    uint64_t            key;                // 见 FLOW_KEY
+    uint8_t             protocol;           // PROTOCOL_TCP / PROTOCOL_UDP
+    uint8_t             family;             // 4 / 6, IPv4 地址只占前 4 字节
+    uint16_t            src_port;
+    uint16_t            dst_port;
+    uint16_t            domain_len;
+    uint8_t             src_ip[16];
+    uint8_t             dst_ip[16];
+    int64_t             ts;                 // 建立或轮转的时间
+} CAPTURE_INDEX_FLOW_BODY;
+
+typedef struct CAPTURE_INDEX_RANGE_ {
+    uint64_t            key;
+    uint64_t            offset;
+    uint64_t            length;             // 区间内都是该流的完整记录
+    int64_t             first_ts;
+    int64_t             last_ts;
+    uint32_t            records;
+    uint32_t            reserved;
+} CAPTURE_INDEX_RANGE_BODY;
+
+typedef struct CAPTURE_INDEX_TIME_ {
+    int64_t             ts;                 // 该偏移处记录的时间戳, 之前的记录不晚于该时间
+    uint64_t            offset;
+} CAPTURE_INDEX_TIME_BODY;
+
+typedef struct CAPTURE_INDEX_FLOW_END_ {
+    uint64_t            key;
+    int64_t             first_ts;
+    int64_t             last_ts;
+    uint64_t            records;
+} CAPTURE_INDEX_FLOW_END_BODY;
+
+#pragma pack(pop)
+
+
+struct FLOW_TRACK_;
+
+
+// 抓包文件旁的索引, 与抓包文件同步打开, 轮转与关闭
+// 记录进入记录链时按链内偏移登记, 写盘后换算成文件偏移, 同一个流相邻的记录合并成一个区间
+// 索引条目在每次写盘后追加到索引文件, 读取方可以按流或时间直接定位到抓包文件中的偏移
+// 压缩输出的偏移无法定位, 不生成索引
+class CaptureIndex {
+
+public:
+    CaptureIndex() = default;
+    ~CaptureIndex() { this->close(); }
+
+    CaptureIndex(const CaptureIndex&) = delete;
+    CaptureIndex& operator=(const CaptureIndex&) = delete;
+
+    // 本次抓包是否生成索引, 关闭时之后的登记都忽略; 抓包开始时调用, 清掉上次残留的条目
+    void setEnabled(bool enable);
+    bool isEnabled() const { return this->m_enabled; }
+
+    // append 为 true 时抓包文件是追加写入的, 已有的索引文件同样追加
+    bool open(const QString &capturePath, CAPTURE_FORMAT format, qint64 sectionOffset, bool append);
+    void close();
+    static QString indexPath(const QString &capturePath) { return capturePath + QStringLiteral(CAPTURE_INDEX_SUFFIX); }
+
+    void describeFlow(const FLOW_TRACK_ &flow, qint64 tsNs);
+    // 流在记录链 chainOffset 处结束, 该处之前的记录写出后再写结束条目
+    void endFlow(qint64 key, qsizetype chainOffset);
+    // 记录链中 [chainOffset, chainOffset + len) 为流 key 的一条记录, tsNs 为 0 表示没有时间戳
+    void addRecord(qint64 key, qsizetype chainOffset, qsizetype len, qint64 tsNs);
+
+    // 记录链从链首写出了 written 字节, 链首位于抓包文件 fileOffset 处
+    void commit(qint64 fileOffset, qsizetype written);
+    // 记录链从链首丢弃了 records 条整记录共 bytes 字节, 已写出一部分的首条记录不计
+    void dropPending(qsizetype records, qsizetype bytes);
+    // 记录链被清空
+    void discardPending();
+
+    // 抓包文件被截断到 fileOffset, 索引文件回退到最后一次覆盖范围不超过该处的写盘
+    // 回退掉的流描述需要调用方重新登记
+    void rollback(qint64 fileOffset);
+    // 抓包文件 fileOffset 之前的内容已确认写完, 不会再回退到更早
+    void settle(qint64 fileOffset);
+
+private:
+    typedef struct PENDING_ {
+        qint64      key;
+        qsizetype   offset;         // 链内偏移, 首条记录写出一部分后为负
+        qsizetype   len;            // 为 -1 表示流结束
+        qint64      tsNs;
+    } PENDING;
+
+    typedef struct RUN_ {
+        qint64      key = -1;
+        qint64      offset = 0;
+        qint64      length = 0;
+        qint64      firstTs = 0;
+        qint64      lastTs = 0;
+        unsigned    records = 0;
+    } RUN;
+
+    typedef struct CHECKPOINT_ {
+        qint64      fileOffset;     // 此前的记录都已登记
+        qint64      indexSize;      // 当时的索引文件长度
+    } CHECKPOINT;
+
+    typedef struct SPAN_ {
+        qint64      firstTs = 0;
+        qint64      lastTs = 0;
+        qint64      records = 0;
+    } SPAN;
+
+    void appendEntry(CAPTURE_INDEX_TYPE type, const void *body, qsizetype len, const QByteArray &extra = QByteArray());
+    void closeRun();
+    void flush();
+
+    bool m_enabled{false};
+    QFile m_file{};
+    // 还没写到索引文件的条目
+    QByteArray m_buffer{};
+    // 还在记录链中的记录, 按链内偏移排列
+    QList<PENDING> m_pending{};
+    // 正在合并的区间
+    RUN m_run{};
+    // 本文件内各流的首末时间与记录数
+    QHash<qint64, SPAN> m_spans{};
+    qint64 m_nextTimeMark{0};
+    qint64 m_indexSize{0};
+    // 每次写盘后的回退点, 只保留最后一个已确认写完的及之后的
+    QList<CHECKPOINT> m_checkpoints{};
+};
+
+
+#endif //PRISM_CAPTURE_INDEX_H
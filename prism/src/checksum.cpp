@@ -0,0 +1,249 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "checksum.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHECKSUM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CHECKSUM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CHECKSUM_TARGET(isa)        __attribute__((target(isa)))
+#else
+#define CHECKSUM_TARGET(isa)
+#endif
+
+
+typedef uint64_t (*CHECKSUM_KERNEL)(const unsigned char *data, qsizetype len, uint64_t sum);
+
+
+// 32 位字累加进 64 位和, 不会溢出, 折叠时与 16 位字累加等价
+static uint64_t partialScalar(const unsigned char *data, qsizetype len, uint64_t sum) {
+
+    uint32_t word32;
+    while ( len >= 4 ) {
+        memcpy(&word32, data, 4);
+        sum += word32;
+        data += 4;
+        len -= 4;
+    }
+
+    uint16_t word16;
+    if ( len >= 2 ) {
+        memcpy(&word16, data, 2);
+        sum += word16;
+        data += 2;
+        len -= 2;
+    }
+
+    // 末尾单字节按补零处理
+    if ( len ) {
+        const unsigned char tail[2] = {data[0], 0};
+        memcpy(&word16, tail, 2);
+        sum += word16;
+    }
+
+    return sum;
+}
+
+#ifdef CHECKSUM_X86
+
+// 16 位字与 0x8000 异或后按有符号数 madd 两两相加到 32 位通道, 最后按字数补回偏置
+// 每次迭代每个通道最多变化 65536, 分块累加保证 4 个累加器合并时 32 位通道不溢出
+#define CHECKSUM_BLOCK_ITERATIONS   4096
+
+CHECKSUM_TARGET("sse2")
+static uint64_t partialSse2(const unsigned char *data, qsizetype len, uint64_t sum) {
+
+    const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while ( len >= 16 ) {
+        qsizetype iterations = qMin<qsizetype>(len / 64, CHECKSUM_BLOCK_ITERATIONS);
+        const bool last = iterations < CHECKSUM_BLOCK_ITERATIONS;
+        qsizetype words = iterations * 32;
+        len -= iterations * 64;
+
+        __m128i acc0 = _mm_setzero_si128();
+        __m128i acc1 = acc0, acc2 = acc0, acc3 = acc0;
+        for ( ; iterations; iterations-- ) {
+            const __m128i v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data)), bias);
+            const __m128i v1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16)), bias);
+            const __m128i v2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32)), bias);
+            const __m128i v3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48)), bias);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(v0, ones));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(v1, ones));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(v2, ones));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(v3, ones));
+            data += 64;
+        }
+
+        // 不足 64 字节的尾部按 16 字节处理, 分段后的报文几乎都会走到这里
+        for ( ; last && len >= 16; len -= 16, data += 16, words += 8 ) {
+            const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data)), bias);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(v, ones));
+        }
+
+        int32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes),
+                         _mm_add_epi32(_mm_add_epi32(acc0, acc1), _mm_add_epi32(acc2, acc3)));
+        sum += static_cast<uint64_t>(static_cast<int64_t>(words) * 0x8000 +
+                                     lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    }
+
+    return partialScalar(data, len, sum);
+}
+
+CHECKSUM_TARGET("avx2")
+static __m256i widenAdd(const __m256i total, const __m256i acc) {
+    return _mm256_add_epi64(_mm256_add_epi64(total, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(acc))),
+                            _mm256_cvtepi32_epi64(_mm256_extracti128_si256(acc, 1)));
+}
+
+CHECKSUM_TARGET("avx2")
+static uint64_t partialAvx2(const unsigned char *data, qsizetype len, uint64_t sum) {
+
+    const __m256i bias = _mm256_set1_epi16(static_cast<short>(0x8000));
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    __m256i total = _mm256_setzero_si256();
+    qsizetype words = 0;
+
+    while ( len >= 32 ) {
+        qsizetype iterations = qMin<qsizetype>(len / 128, CHECKSUM_BLOCK_ITERATIONS);
+        const bool last = iterations < CHECKSUM_BLOCK_ITERATIONS;
+        words += iterations * 64;
+        len -= iterations * 128;
+
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = acc0, acc2 = acc0, acc3 = acc0;
+        for ( ; iterations; iterations-- ) {
+            const __m256i v0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)), bias);
+            const __m256i v1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32)), bias);
+            const __m256i v2 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 64)), bias);
+            const __m256i v3 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 96)), bias);
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(v0, ones));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(v1, ones));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(v2, ones));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(v3, ones));
+            data += 128;
+        }
+
+        for ( ; last && len >= 32; len -= 32, data += 32, words += 16 ) {
+            const __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)), bias);
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(v, ones));
+        }
+
+        total = widenAdd(total, _mm256_add_epi32(_mm256_add_epi32(acc0, acc1), _mm256_add_epi32(acc2, acc3)));
+    }
+
+    // 最后不足 32 字节的整 4 字节部分用 maskload 一次读入, 屏蔽掉的通道为 0, 同样按字数补偏置
+    if ( len >= 4 ) {
+        const int count = static_cast<int>(len / 4);
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        const __m256i v = _mm256_xor_si256(_mm256_maskload_epi32(reinterpret_cast<const int *>(data), mask), bias);
+        total = widenAdd(total, _mm256_madd_epi16(v, ones));
+        words += 16;
+        data += count * 4;
+        len -= count * 4;
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), total);
+    sum += static_cast<uint64_t>(static_cast<int64_t>(words) * 0x8000 + lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+
+    // 回到非 VEX 编码的代码前清掉高半部分, 避免状态切换惩罚
+    _mm256_zeroupper();
+    return partialScalar(data, len, sum);
+}
+
+static bool cpuHasAvx2() {
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    // OSXSAVE 与 AVX, 且系统保存了 YMM 状态
+    if ( (info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 ) return false;
+    if ( (_xgetbv(0) & 6) != 6 ) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool cpuHasSse2() {
+
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif // CHECKSUM_X86
+
+
+typedef struct CHECKSUM_IMPL_ {
+    CHECKSUM_KERNEL kernel;
+    const char *name;
+} CHECKSUM_IMPL;
+
+static const CHECKSUM_IMPL &selectImpl() {
+
+    static const CHECKSUM_IMPL impl = []() -> CHECKSUM_IMPL {
+#ifdef CHECKSUM_X86
+        if ( cpuHasAvx2() ) return {&partialAvx2, "avx2"};
+        if ( cpuHasSse2() ) return {&partialSse2, "sse2"};
+#endif
+        return {&partialScalar, "scalar"};
+    }();
+    return impl;
+}
+
+
+uint64_t Checksum::partial(const void *data, const qsizetype len, const uint64_t sum) {
+
+    if ( len <= 0 ) return sum;
+    return selectImpl().kernel(static_cast<const unsigned char *>(data), len, sum);
+}
+
+uint16_t Checksum::finish(uint64_t sum) {
+
+    while ( sum >> 16u ) {
+        sum = (sum & 0xFFFFu) + (sum >> 16u);
+    }
+    return static_cast<uint16_t>(~sum & 0xFFFFu);
+}
+
+const char *Checksum::kernel() {
+    return selectImpl().name;
+}
@@ -0,0 +1,46 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_CHECKSUM_H
+#define PRISM_CHECKSUM_H
+
+#include <QtGlobal>
+#include <cstdint>
+
+
+// Internet 校验和 (RFC 1071)
+// 按本机字节序累加 16 位字, 结果同样按本机字节序直接写回报文, 无需再转换字节序
+// x86 上运行时在 AVX2 / SSE2 / 标量实现之间选择一次
+class Checksum {
+
+public:
+    // 累加 data 的部分和, 未折叠, 可以继续传给下一次调用
+    // 只有最后一段允许为奇数长度
+    static uint64_t partial(const void *data, qsizetype len, uint64_t sum = 0);
+    // 折叠为 16 位并取反
+    static uint16_t finish(uint64_t sum);
+    // 当前选用的实现: avx2 / sse2 / scalar
+    static const char *kernel();
+};
+
+
+#endif //PRISM_CHECKSUM_H
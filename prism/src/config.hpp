@@ -49,6 +49,40 @@ public:
 
     bool runAsSocks5{true};
 
+    // 抓包记录构建与写盘放到独立写线程
+    bool dumpInThread{true};
+    // 输出格式, 取值见 CAPTURE_FORMAT
+    int dumpFormat{0};
+    // 合成报文填写正确的校验和
+    bool dumpChecksum{false};
+    // 精简编码: 不写以太网头, 不合成数据段的 ACK
+    bool dumpLean{false};
+    // 在抓包文件旁写出 .idx 索引
+    bool dumpIndex{true};
+    // 压缩方式, 取值见 CAPTURE_CODEC
+    int dumpCodec{0};
+    // 写文件方式, 取值见 CAPTURE_IO
+    int dumpIo{0};
+    // io_uring 下每次写盘后异步 fdatasync
+    bool dumpFsync{false};
+    // 文件轮转: 单个文件的最大 MB 与秒数, 保留的文件数, 0 表示不限
+    unsigned int rotateMegaBytes{0};
+    unsigned int rotateSeconds{0};
+    unsigned int rotateFiles{0};
+    // TCP 明文切分的段长, 0 表示按地址族取默认值
+    unsigned int dumpMss{0};
+    // TCP 同方向小块明文合并的时间窗口微秒与字节上限, 0 微秒表示不合并, 0 字节表示按 MSS
+    unsigned int coalesceMicroseconds{0};
+    unsigned int coalesceBytes{0};
+    // 每个流每个方向最多写入的明文 KB, 0 表示不限
+    unsigned int budgetTxKiloBytes{0};
+    unsigned int budgetRxKiloBytes{0};
+    // 写盘失败时待写记录的内存上限 MB, 0 表示不限; 超限策略, 取值见 DUMP_DROP_POLICY
+    unsigned int cachingLimitMegaBytes{64};
+    int dropPolicy{0};
+    // 抓包过滤表达式, 空串表示全部抓取, 语法见 CaptureFilter
+    QString captureFilter{};
+
 private:
     ConfigVars() = default;
     ~ConfigVars() = default;
@@ -0,0 +1,193 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/20.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef FLAT_MAP_HPP
+#define FLAT_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// 以 64 位整数为键的开放寻址哈希表, 线性探测, 容量为 2 的幂
+// 键与值分两个数组存放, 探测只扫描连续的键, 一个缓存行容纳 8 个键, 命中后才访问值
+// 删除时把后续同簇的元素前移, 不留墓碑, 长期增删后查找长度不会退化
+// 键不能为 FLAT_MAP_EMPTY_KEY; 非线程安全
+#define FLAT_MAP_EMPTY_KEY      (~static_cast<uint64_t>(0))
+#define FLAT_MAP_MIN_CAPACITY   64
+
+template<typename V>
+class FlatHashMap {
+public:
+    explicit FlatHashMap(const size_t capacity = FLAT_MAP_MIN_CAPACITY) {
+        this->allocate(roundUp(capacity));
+    }
+
+    FlatHashMap(const FlatHashMap&) = delete;
+    FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+    V *find(const uint64_t key) {
+        const size_t slot = this->locate(key);
+        return slot != npos ? &m_values[slot] : nullptr;
+    }
+
+    const V *find(const uint64_t key) const {
+        const size_t slot = this->locate(key);
+        return slot != npos ? &m_values[slot] : nullptr;
+    }
+
+    bool contains(const uint64_t key) const { return this->locate(key) != npos; }
+
+    // 插入或更新
+    void set(const uint64_t key, V value) {
+        // 负载不超过 3/4
+        if ((m_size + 1) * 4 > (m_mask + 1) * 3) {
+            this->rehash((m_mask + 1) * 2);
+        }
+
+        size_t slot = hash(key) & m_mask;
+        while (m_keys[slot] != FLAT_MAP_EMPTY_KEY) {
+            if (m_keys[slot] == key) {
+                m_values[slot] = std::move(value);
+                return;
+            }
+            slot = (slot + 1) & m_mask;
+        }
+        m_keys[slot] = key;
+        m_values[slot] = std::move(value);
+        ++m_size;
+    }
+
+    // 取出并删除, 不存在时返回默认值
+    V take(const uint64_t key) {
+        size_t slot = this->locate(key);
+        if (slot == npos) return V();
+
+        V value = std::move(m_values[slot]);
+        this->erase(slot);
+        return value;
+    }
+
+    bool remove(const uint64_t key) {
+        const size_t slot = this->locate(key);
+        if (slot == npos) return false;
+        this->erase(slot);
+        return true;
+    }
+
+    size_t size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    size_t capacity() const { return m_mask + 1; }
+
+    void clear() {
+        this->allocate(FLAT_MAP_MIN_CAPACITY);
+    }
+
+    // 遍历元素, 期间不能增删
+    template<typename F>
+    void forEach(F &&func) const {
+        for (size_t slot = 0; slot <= m_mask; slot++) {
+            if (m_keys[slot] != FLAT_MAP_EMPTY_KEY) {
+                func(m_keys[slot], m_values[slot]);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t npos = ~static_cast<size_t>(0);
+
+    static size_t roundUp(const size_t value) {
+        size_t result = FLAT_MAP_MIN_CAPACITY;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    // 流键的低位是递增的流 id, 高位是协议, 打散后再取低位
+    static size_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<size_t>(key);
+    }
+
+    size_t locate(const uint64_t key) const {
+        size_t slot = hash(key) & m_mask;
+        while (m_keys[slot] != FLAT_MAP_EMPTY_KEY) {
+            if (m_keys[slot] == key) return slot;
+            slot = (slot + 1) & m_mask;
+        }
+        return npos;
+    }
+
+    // 向后移动删除: 把之后探测链上可以前移的元素补到空位
+    void erase(size_t slot) {
+        size_t next = slot;
+        while (true) {
+            next = (next + 1) & m_mask;
+            if (m_keys[next] == FLAT_MAP_EMPTY_KEY) break;
+
+            const size_t home = hash(m_keys[next]) & m_mask;
+            // home 不在 (slot, next] 之间时可以移到 slot
+            const bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+            if (stays) continue;
+
+            m_keys[slot] = m_keys[next];
+            m_values[slot] = std::move(m_values[next]);
+            slot = next;
+        }
+        m_keys[slot] = FLAT_MAP_EMPTY_KEY;
+        m_values[slot] = V();
+        --m_size;
+    }
+
+    void allocate(const size_t capacity) {
+        m_keys.assign(capacity, FLAT_MAP_EMPTY_KEY);
+        m_values.clear();
+        m_values.resize(capacity);
+        m_mask = capacity - 1;
+        m_size = 0;
+    }
+
+    void rehash(const size_t capacity) {
+        std::vector<uint64_t> keys = std::move(m_keys);
+        std::vector<V> values = std::move(m_values);
+        this->allocate(capacity);
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == FLAT_MAP_EMPTY_KEY) continue;
+            size_t slot = hash(keys[i]) & m_mask;
+            while (m_keys[slot] != FLAT_MAP_EMPTY_KEY) {
+                slot = (slot + 1) & m_mask;
+            }
+            m_keys[slot] = keys[i];
+            m_values[slot] = std::move(values[i]);
+            ++m_size;
+        }
+    }
+
+    std::vector<uint64_t> m_keys;
+    std::vector<V> m_values;
+    size_t m_mask{0};
+    size_t m_size{0};
+};
+
+#endif //FLAT_MAP_HPP
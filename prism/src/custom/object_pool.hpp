@@ -0,0 +1,169 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/22.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// 对象池: 按块申请槽位, 释放的槽位挂回空闲链表, 只在池销毁时归还给堆
+// 申请与释放可以在不同线程, 每个对象只加锁一次
+#define OBJECT_POOL_SLAB_SIZE   256
+
+// 池化对象的侵入式引用计数, 放在对象内部, 不再单独分配控制块
+struct PoolCounted {
+    std::atomic<int> poolRefs{0};
+};
+
+template<typename T>
+class ObjectPool {
+public:
+    ObjectPool() = default;
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // 每个类型一个共享池, 进程退出前不释放
+    static ObjectPool& shared() {
+        static auto *pool = new ObjectPool;
+        return *pool;
+    }
+
+    template<typename... Args>
+    T *acquire(Args&&... args) {
+        Slot *slot;
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            if (!m_free) this->grow();
+            slot = m_free;
+            m_free = slot->next;
+            ++m_inUse;
+        }
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void release(T *object) {
+        object->~T();
+        auto *slot = reinterpret_cast<Slot *>(object);
+        std::lock_guard<std::mutex> locker(m_mutex);
+        slot->next = m_free;
+        m_free = slot;
+        --m_inUse;
+    }
+
+    // 已申请的槽位数与正在使用的对象数
+    size_t capacity() const {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        return m_slabs.size() * OBJECT_POOL_SLAB_SIZE;
+    }
+
+    size_t inUse() const {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        return m_inUse;
+    }
+
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void grow() {
+        auto slab = std::make_unique<Slot[]>(OBJECT_POOL_SLAB_SIZE);
+        for (size_t i = 0; i < OBJECT_POOL_SLAB_SIZE; i++) {
+            slab[i].next = i + 1 < OBJECT_POOL_SLAB_SIZE ? &slab[i + 1] : m_free;
+        }
+        m_free = &slab[0];
+        m_slabs.push_back(std::move(slab));
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Slot[]>> m_slabs;
+    Slot *m_free{nullptr};
+    size_t m_inUse{0};
+};
+
+// 指向池化对象的共享指针, 用法与 QSharedPointer 相同
+// T 需要继承 PoolCounted, 最后一个引用释放时对象析构并回到 ObjectPool<T>::shared()
+template<typename T>
+class PoolPtr {
+public:
+    PoolPtr() = default;
+    PoolPtr(std::nullptr_t) {}
+
+    template<typename... Args>
+    static PoolPtr create(Args&&... args) {
+        return PoolPtr(ObjectPool<T>::shared().acquire(std::forward<Args>(args)...));
+    }
+
+    PoolPtr(const PoolPtr &other) : m_object(other.m_object) { this->retain(); }
+    PoolPtr(PoolPtr &&other) noexcept : m_object(other.m_object) { other.m_object = nullptr; }
+
+    PoolPtr& operator=(const PoolPtr &other) {
+        if (this != &other) {
+            PoolPtr(other).swap(*this);
+        }
+        return *this;
+    }
+
+    PoolPtr& operator=(PoolPtr &&other) noexcept {
+        PoolPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~PoolPtr() { this->drop(); }
+
+    T *operator->() const { return m_object; }
+    T &operator*() const { return *m_object; }
+    T *data() const { return m_object; }
+    bool isNull() const { return !m_object; }
+    explicit operator bool() const { return m_object != nullptr; }
+    bool operator==(const PoolPtr &other) const { return m_object == other.m_object; }
+    bool operator!=(const PoolPtr &other) const { return m_object != other.m_object; }
+
+    void reset() { PoolPtr().swap(*this); }
+    void swap(PoolPtr &other) noexcept { std::swap(m_object, other.m_object); }
+
+private:
+    explicit PoolPtr(T *object) : m_object(object) { this->retain(); }
+
+    void retain() const {
+        if (m_object) m_object->poolRefs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void drop() {
+        if (m_object && m_object->poolRefs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ObjectPool<T>::shared().release(m_object);
+        }
+        m_object = nullptr;
+    }
+
+    T *m_object{nullptr};
+};
+
+#endif //OBJECT_POOL_HPP
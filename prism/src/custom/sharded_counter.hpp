@@ -0,0 +1,85 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/24.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef SHARDED_COUNTER_HPP
+#define SHARDED_COUNTER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 分片数与缓存行大小
+#define COUNTER_SHARDS          16
+#define COUNTER_CACHE_LINE      64
+
+// 64 位计数器组, 按线程分片, 每个分片独占缓存行
+// 线程第一次计数时分到一个分片, 之后只写该分片, 多个事件循环之间没有伪共享
+// 读取时把所有分片相加; 递减用 sub, 各分片按 2^64 取模相加后结果正确
+template<size_t N>
+class ShardedCounters {
+public:
+    ShardedCounters() = default;
+
+    ShardedCounters(const ShardedCounters&) = delete;
+    ShardedCounters& operator=(const ShardedCounters&) = delete;
+
+    void add(const size_t counter, const uint64_t value) {
+        // 超过 COUNTER_SHARDS 个线程时分片会共用, 因此仍用原子加
+        m_shards[shardIndex()].values[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void sub(const size_t counter, const uint64_t value) {
+        this->add(counter, ~value + 1);
+    }
+
+    uint64_t sum(const size_t counter) const {
+        uint64_t total = 0;
+        for (const auto &shard : m_shards) {
+            total += shard.values[counter].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // 计数线程都停止后调用
+    void reset() {
+        for (auto &shard : m_shards) {
+            for (auto &value : shard.values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(COUNTER_CACHE_LINE) Shard {
+        std::atomic<uint64_t> values[N] = {};
+    };
+
+    static size_t shardIndex() {
+        static std::atomic<size_t> next{0};
+        thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % COUNTER_SHARDS;
+        return index;
+    }
+
+    Shard m_shards[COUNTER_SHARDS];
+};
+
+#endif //SHARDED_COUNTER_HPP
@@ -23,558 +23,1399 @@
 
 #include "dump.h"
 #include <QDateTime>
-#include <QFile>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <limits>
 #include "misc.h"
-
-static QByteArray buildTcpHandshakePkt(const QSharedPointer<FLOW_TRACK> &flow);
-static QByteArray buildTcpFinPkt(const QSharedPointer<FLOW_TRACK> &flow, bool sendOut);
-static QByteArray buildTcpPayloadPkt(const QSharedPointer<FLOW_TRACK> &flow, const char *data, size_t dataLen, bool sendOut);
-static QByteArray buildUdpPayloadPkt(const QSharedPointer<FLOW_TRACK> &flow, const char *data, size_t dataLen, bool sendOut);
-static bool writePktsOut(const QString &filePath, const QByteArray &fileContent);
+#include "checksum.h"
+#include "capture_clock.h"
+
+static void initHeaderTemplates(const PoolPtr<FLOW_TRACK> &flow, CAPTURE_FORMAT format, unsigned short mss, bool checksums, bool lean);
+static qint64 buildTcpHandshakePkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, qint64 tsNs);
+static qint64 buildTcpResumePkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, qint64 tsNs);
+static qint64 buildTcpFinPkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, qint64 tsNs, bool sendOut);
+static qint64 buildTcpPayloadPkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, qint64 tsNs, const QByteArray &payload, bool sendOut, bool headersOnly);
+static qint64 buildUdpPayloadPkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, qint64 tsNs, const QByteArray &payload, bool sendOut, bool headersOnly);
+static void skipTcpPayload(const PoolPtr<FLOW_TRACK> &flow, qint64 skipped, bool sendOut);
+static void dropTcpPayload(const PoolPtr<FLOW_TRACK> &flow, qint64 bytes, bool sendOut);
 
 static void createEthernetHeader(ETHERNET_HEADER *ethernet, bool sendOut, bool isIpv6);
-static void createIpHeader(IP_HEADER *ipHdr, const QSharedPointer<FLOW_TRACK> &flow, unsigned int payloadLen, bool sendOut);
-static void createTcpHeader(TCP_HEADER *tcpHdr, const QSharedPointer<FLOW_TRACK> &flow, unsigned char flags, bool sendOut);
-static void createUdpHeader(UDP_HEADER *udpHdr, const QSharedPointer<FLOW_TRACK> &flow, unsigned int payloadLen, bool sendOut);
-static void createSynAckPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt);
-static void createSynPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt);
-static void createSynDonePkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt);
-static void createTcpFinPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt, bool sendOut);
-static void createTcpAckPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt, bool sendOut);
-static void createTcpDataPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt, unsigned int payloadLen, bool sendOut);
-static void createUdpDataPkt(const QSharedPointer<FLOW_TRACK> &flow, UDP_PKT *udpPkt, unsigned int payloadLen, bool sendOut);
+static void createIpHeader(IP_HEADER *ipHdr, const PoolPtr<FLOW_TRACK> &flow, bool sendOut);
+static void createTcpHeader(TCP_HEADER *tcpHdr, const PoolPtr<FLOW_TRACK> &flow, bool sendOut);
+static void createUdpHeader(UDP_HEADER *udpHdr, const PoolPtr<FLOW_TRACK> &flow, bool sendOut);
+
 
 
 
 
+// 有过滤器时才构造过滤器输入, 地址文本在这里生成
+static FILTER_INPUT makeFilterInput(const FLOW_RECORD &flow) {
 
-void PacketDumper::onStreamConnectionMade(const char *domainLocal, const char *addrLocal, unsigned short portLocal,
-    const char *domainRemote, const char *addrRemote, unsigned short portRemote, const int streamIndex) {
+    FILTER_INPUT input;
+    input.isTcp = flow.isStream;
+    input.isIpv6 = flow.remote.isIpv6();
+    input.domain = flow.domain;
+    input.remote = flow.remote.toHostAddress();
+    input.remoteAddr = input.remote.toString().toLatin1();
+    input.remotePort = flow.remote.hostPort();
+    input.client = flow.local.toHostAddress();
+    return input;
+}
 
-    (void)domainLocal;
-    (void)domainRemote;
+void PacketDumper::onStreamConnectionMade(FLOW_RECORD &flow) {
 
-    const auto key = MiscFuncs::genFlowKey(true, streamIndex);
-    Q_ASSERT(!this->m_flows.contains(key));
+    // 被过滤的流不建立跟踪, 之后的数据在中继线程直接丢弃
+    if ( !this->admitFlow(flow) ) return;
 
-    const auto flow = QSharedPointer<FLOW_TRACK>::create(
-        QHostAddress(addrLocal),
-        QHostAddress(addrRemote),
-        portLocal,
-        portRemote,
+    DUMP_EVENT event;
+    event.type = DUMP_STREAM_MADE;
+    event.index = flow.index;
+    event.timestamp = CaptureClock::nowNs();
+    event.flow = PoolPtr<FLOW_TRACK>::create(
+        flow.local,
+        flow.remote,
         PROTOCOL_TCP,
         0,
         0
         );
-    this->m_flows.set(key, flow);
-
-    const auto bytes = buildTcpHandshakePkt(flow);
-    this->m_cachingBytes.append(bytes);
-    this->savePkts(false);
+    event.flow->domain = flow.domain;
+    initHeaderTemplates(event.flow, this->m_format, this->m_tcpMss, this->m_checksums, this->m_lean);
+    this->postEvent(std::move(event));
 }
 
-void PacketDumper::onStreamTeardown(const int streamIndex) {
+void PacketDumper::onStreamTeardown(const FLOW_RECORD &flow) {
 
-    const auto key = MiscFuncs::genFlowKey(true, streamIndex);
-    Q_ASSERT(this->m_flows.contains(key));
+    if ( !flow.gate.capture ) return;
 
-    const auto flow = this->m_flows.get(key);
+    // 最后一块之后仍有丢弃或超出预算的字节时补一个不带数据的事件, FIN 的 seq 才能对上
+    for ( const bool sendOut : {false, true} ) {
+        if ( !flow.gate.dropped[sendOut] && !flow.gate.skipped[sendOut] ) continue;
 
-    const auto bytes = buildTcpFinPkt(flow.value(), true);
-    this->m_cachingBytes.append(bytes);
-    this->savePkts(false);
+        DUMP_EVENT gap;
+        gap.type = DUMP_STREAM_DATA;
+        gap.index = flow.index;
+        gap.sendOut = sendOut;
+        gap.timestamp = CaptureClock::nowNs();
+        gap.dropped = flow.gate.dropped[sendOut];
+        gap.skipped = flow.gate.skipped[sendOut];
+        this->postEvent(std::move(gap));
+    }
 
-    this->m_flows.remove(key);
+    DUMP_EVENT event;
+    event.type = DUMP_STREAM_TEARDOWN;
+    event.index = flow.index;
+    event.timestamp = CaptureClock::nowNs();
+    this->postEvent(std::move(event));
 }
 
-void PacketDumper::onPlainStream(const char *data, const size_t dataLen, const bool sendOut, const int streamIndex) {
-
-    const auto key = MiscFuncs::genFlowKey(true, streamIndex);
-    Q_ASSERT(this->m_flows.contains(key));
+void PacketDumper::onPlainStream(FLOW_RECORD &flow, const char *data, const size_t dataLen, const bool sendOut) {
 
-    const auto flow = this->m_flows.get(key);
+    if ( !flow.gate.capture ) return;
+    const qsizetype keep = consumeBudget(flow.gate, true, sendOut, static_cast<qsizetype>(dataLen));
+    // 预算已用完: 不再投递事件, 字节数记在闸门上, 断开时一并交给写线程
+    if ( keep == 0 && dataLen > 0 ) {
+        this->m_truncatedBytes += dataLen;
+        flow.gate.skipped[sendOut] += static_cast<qint64>(dataLen);
+        return;
+    }
 
-    const auto bytes = buildTcpPayloadPkt(flow.value(), data, dataLen, sendOut);
-    this->m_cachingBytes.append(bytes);
-    this->savePkts(false);
+    DUMP_EVENT event;
+    event.type = DUMP_STREAM_DATA;
+    event.index = flow.index;
+    event.sendOut = sendOut;
+    event.timestamp = CaptureClock::nowNs();
+    // 超出预算的部分不拷贝, 只把字节数交给写线程
+    event.payload = QByteArray(data, keep);
+    event.skipped = static_cast<qint64>(dataLen) - keep;
+    if ( event.skipped ) this->m_truncatedBytes += event.skipped;
+    // 之前因队列满丢弃的字节随本块交给写线程, 本块也被丢弃时一并留到下一块
+    event.dropped = flow.gate.dropped[sendOut];
+    flow.gate.dropped[sendOut] = 0;
+    const qint64 carried = event.dropped + static_cast<qint64>(dataLen);
+    if ( !this->postEvent(std::move(event)) ) {
+        flow.gate.dropped[sendOut] = carried;
+    }
 }
 
-void PacketDumper::onDgramConnectionMade(const char *domainLocal, const char *addrLocal, unsigned short portLocal,
-    const char *domainRemote, const char *addrRemote, unsigned short portRemote, const int dgramIndex) {
-
-    (void)domainLocal;
-    (void)domainRemote;
+void PacketDumper::onDgramConnectionMade(FLOW_RECORD &flow) {
 
-    const auto key = MiscFuncs::genFlowKey(false, dgramIndex);
-    Q_ASSERT(!this->m_flows.contains(key));
+    if ( !this->admitFlow(flow) ) return;
 
-    const auto flow = QSharedPointer<FLOW_TRACK>::create(
-        QHostAddress(addrLocal),
-        QHostAddress(addrRemote),
-        portLocal,
-        portRemote,
+    DUMP_EVENT event;
+    event.type = DUMP_DGRAM_MADE;
+    event.index = flow.index;
+    event.timestamp = CaptureClock::nowNs();
+    event.flow = PoolPtr<FLOW_TRACK>::create(
+        flow.local,
+        flow.remote,
         PROTOCOL_UDP,
         0,
         0
         );
-    this->m_flows.set(key, flow);
+    event.flow->domain = flow.domain;
+    initHeaderTemplates(event.flow, this->m_format, this->m_tcpMss, this->m_checksums, this->m_lean);
+    this->postEvent(std::move(event));
 }
 
-void PacketDumper::onDgramTeardown(const int dgramIndex) {
+void PacketDumper::onDgramTeardown(const FLOW_RECORD &flow) {
+
+    if ( !flow.gate.capture ) return;
 
-    const auto key = MiscFuncs::genFlowKey(false, dgramIndex);
-    Q_ASSERT(this->m_flows.contains(key));
+    // 超出预算的字节数在断开时交给写线程计入截断统计
+    for ( const bool sendOut : {false, true} ) {
+        if ( !flow.gate.skipped[sendOut] ) continue;
+
+        DUMP_EVENT gap;
+        gap.type = DUMP_DGRAM_DATA;
+        gap.index = flow.index;
+        gap.sendOut = sendOut;
+        gap.timestamp = CaptureClock::nowNs();
+        gap.skipped = flow.gate.skipped[sendOut];
+        this->postEvent(std::move(gap));
+    }
 
-    this->m_flows.remove(key);
+    DUMP_EVENT event;
+    event.type = DUMP_DGRAM_TEARDOWN;
+    event.index = flow.index;
+    event.timestamp = CaptureClock::nowNs();
+    this->postEvent(std::move(event));
 }
 
-void PacketDumper::onPlainDgram(const char *data, const size_t dataLen, const bool sendOut, const int dgramIndex) {
+void PacketDumper::onPlainDgram(FLOW_RECORD &flow, const char *data, const size_t dataLen, const bool sendOut) {
 
-    const auto key = MiscFuncs::genFlowKey(false, dgramIndex);
-    Q_ASSERT(this->m_flows.contains(key));
+    if ( !flow.gate.capture ) return;
+    const qsizetype keep = consumeBudget(flow.gate, false, sendOut, static_cast<qsizetype>(dataLen));
+    if ( keep == 0 && dataLen > 0 ) {
+        this->m_truncatedBytes += dataLen;
+        flow.gate.skipped[sendOut] += static_cast<qint64>(dataLen);
+        return;
+    }
+
+    DUMP_EVENT event;
+    event.type = DUMP_DGRAM_DATA;
+    event.index = flow.index;
+    event.sendOut = sendOut;
+    event.timestamp = CaptureClock::nowNs();
+    // 超出预算的部分不拷贝, 只把字节数交给写线程
+    event.payload = QByteArray(data, keep);
+    event.skipped = static_cast<qint64>(dataLen) - keep;
+    if ( event.skipped ) this->m_truncatedBytes += event.skipped;
+    this->postEvent(std::move(event));
+}
 
-    const auto flow = this->m_flows.get(key);
 
-    const auto bytes = buildUdpPayloadPkt(flow.value(), data, dataLen, sendOut);
-    this->m_cachingBytes.append(bytes);
-    this->savePkts(false);
+// 中继线程中对新流求值过滤器, 结果与预算写入流的闸门
+// 返回 false 表示该流不抓取
+bool PacketDumper::admitFlow(FLOW_RECORD &flow) {
+
+    FLOW_GATE &gate = flow.gate;
+    if ( !this->m_filter.isEmpty() && !this->m_filter.matches(makeFilterInput(flow)) ) {
+        gate.capture = false;
+        this->m_filteredFlows++;
+        return false;
+    }
+
+    gate.capture = true;
+    gate.budgetLeft[false] = this->m_budget[false] > 0 ? this->m_budget[false] : -1;
+    gate.budgetLeft[true] = this->m_budget[true] > 0 ? this->m_budget[true] : -1;
+    return true;
 }
 
+// 扣减流的剩余预算, 返回本块中需要写入的字节数
+// TCP 按字节截断; UDP 数据报不拆分, 预算未用完时整个保留
+qsizetype PacketDumper::consumeBudget(FLOW_GATE &gate, const bool isStream, const bool sendOut, const qsizetype len) {
 
-void PacketDumper::savePkts(const bool flush) {
+    qint64 &left = gate.budgetLeft[sendOut];
+    if ( left < 0 ) return len;
 
-    if ( this->m_cachingBytes.isEmpty() ) {
-        this->m_cachingBytesLen = 0;
-        return ;
+    const qsizetype keep = isStream ? qMin<qsizetype>(left, len) : (left > 0 ? len : 0);
+    left = qMax<qint64>(0, left - keep);
+    return keep;
+}
+
+void PacketDumper::start(const bool threaded) {
+
+    Q_ASSERT(!this->m_writer.joinable());
+
+    this->m_threaded = threaded;
+    this->m_resolvedNames.clear();
+    this->m_ringFiles.clear();
+    this->m_overflow.clear();
+    this->m_overflowDepth = 0;
+    this->m_file.setLinkType(this->m_lean ? CAPTURE_LINKTYPE_RAW : CAPTURE_LINKTYPE_ETHERNET);
+    // 压缩后的偏移无法定位
+    this->m_index.setEnabled(this->m_indexWanted && this->m_format != CAPTURE_FORMAT_RAW &&
+                             this->m_codec == CAPTURE_CODEC_NONE && !this->m_pcapFilePath.isEmpty());
+    this->m_filesOpened = 0;
+    this->m_openRetryMs = 0;
+    this->m_file.resetStats();
+    this->m_queueDrops = 0;
+    this->m_writeLatencyUs = 0;
+    this->m_writeLatencyMaxUs = 0;
+    this->m_truncatedBytes = 0;
+    this->m_filteredFlows = 0;
+    this->m_drops = 0;
+    this->m_nextTsNs = 0;
+    CaptureClock::anchor();
+    this->m_dropBytes = 0;
+    this->m_dropFlows = 0;
+    this->m_coalescing.clear();
+    this->m_coalescedChunks = 0;
+    this->m_cachingChain.setRecordTracking(this->m_cachingLimit > 0 && this->m_dropPolicy == DUMP_DROP_OLDEST);
+
+    // 原始流模式输出到抓包文件旁的 <文件名>_streams_<时间> 目录
+    if ( this->m_format == CAPTURE_FORMAT_RAW && !this->m_pcapFilePath.isEmpty() ) {
+        const QFileInfo info(this->m_pcapFilePath);
+        this->m_streams.setDirectory(QStringLiteral("%1/%2_streams_%3").arg(
+            info.absolutePath(),
+            info.completeBaseName(),
+            QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMddhhmmss"))));
+    } else {
+        this->m_streams.setDirectory(QString());
     }
 
-    if ( !this->m_pcapFilePath.isEmpty() ) {
-        if ( this->m_cachingBytes.size() >= CACHING_BUFFER_MAX_BYTES || flush || this->timerExpired() ) {
+    if (threaded) {
+        this->m_stopping = false;
+        this->m_writer = std::thread(&PacketDumper::writerRoutine, this);
+    }
+}
+
+void PacketDumper::stop() {
 
-            const bool bok = writePktsOut(this->m_pcapFilePath, this->m_cachingBytes);
-            if (bok)
-                this->m_cachingBytes.clear();
+    if (this->m_writer.joinable()) {
+        // 中继线程已退出, 由这里补投积压的事件, 写线程仍在消费
+        while (!this->drainOverflow()) {
+            std::this_thread::yield();
         }
+        // 写线程退出前会清空队列并刷盘
+        this->m_stopping = true;
+        this->m_writer.join();
+    } else {
+        this->expireCoalesced(std::numeric_limits<qint64>::max());
+        this->savePkts(true);
     }
+    // 最后仍没能写出的记录丢弃, 不带到下一次抓包
+    if ( !this->m_cachingChain.isEmpty() ) {
+        this->m_drops += 1;
+        this->m_dropBytes += this->m_cachingChain.bytes();
+        this->m_cachingChain.clear();
+        this->m_cachingBytesLen = 0;
+        this->m_index.discardPending();
+    }
+    this->m_file.close();
+    this->countFileLoss(this->m_file.size());
+    this->m_index.close();
+    this->m_streams.closeAll();
+    this->m_threaded = false;
+}
 
-    this->m_cachingBytesLen = this->m_cachingBytes.size();
+DUMP_STATS PacketDumper::getDumpStats() const {
+
+    DUMP_STATS stats = {};
+    stats.threaded          = this->m_threaded;
+    stats.queueDepth        = this->m_ring.size() + this->m_overflowDepth;
+    stats.queueCapacity     = this->m_ring.capacity();
+    stats.queueDrops        = this->m_queueDrops;
+    stats.writeLatencyUs    = this->m_writeLatencyUs;
+    stats.writeLatencyMaxUs = this->m_writeLatencyMaxUs;
+    stats.filesOpened       = this->m_filesOpened;
+    stats.codecRawBytes     = this->m_file.rawBytes();
+    stats.codecBytes        = this->m_file.codecBytes();
+    stats.codecCpuUs        = this->m_file.codecCpuUs();
+    stats.openStreams       = this->m_streams.openFlows();
+    stats.truncatedBytes    = this->m_truncatedBytes;
+    stats.filteredFlows     = this->m_filteredFlows;
+    stats.cachingLimit      = this->m_cachingLimit;
+    stats.dropPolicy        = this->m_dropPolicy;
+    stats.drops             = this->m_drops;
+    stats.dropBytes         = this->m_dropBytes;
+    stats.dropFlows         = this->m_dropFlows;
+    stats.coalescedChunks   = this->m_coalescedChunks;
+    stats.ioErrors          = this->m_file.ioErrors();
+    return stats;
 }
 
-bool PacketDumper::timerExpired() {
-    bool result = false;
-    if (this->m_lastRefreshTimer.hasExpired(FILE_FLUSH_INTERVAL_MS)) {
-        this->m_lastRefreshTimer.restart();
-        result = true;
+// 返回 false 表示数据事件因队列满被丢弃, 事件内容未被移走
+// 中继线程从不等待写线程: 队列满时带数据的事件丢弃, 其余事件放进积压表, 下次投递前按顺序补投
+bool PacketDumper::postEvent(DUMP_EVENT &&event) {
+
+    if (!this->m_threaded) {
+        this->processEvent(event);
+        return true;
     }
-    return result;
+
+    // 积压表不为空时新事件排在其后, 保持同一个流的事件顺序
+    if (this->drainOverflow() && this->m_ring.push(std::move(event))) {
+        return true;
+    }
+
+    // 带数据的事件直接丢弃, 由调用方记下字节数
+    // 连接建立/断开与只带字节数的事件必须送达, 否则写线程中的流状态与 seq 会错乱; 这类事件按流计数, 积压表不随流量增长
+    if ((event.type == DUMP_STREAM_DATA || event.type == DUMP_DGRAM_DATA) && !event.payload.isEmpty()) {
+        ++this->m_queueDrops;
+        return false;
+    }
+    this->m_overflow.append(std::move(event));
+    this->m_overflowDepth = this->m_overflow.size();
+    return true;
 }
 
+// 把积压的事件按顺序放入队列, 全部放入后返回 true
+bool PacketDumper::drainOverflow() {
 
-static QByteArray buildTcpHandshakePkt(const QSharedPointer<FLOW_TRACK> &flow) {
+    if (this->m_overflow.isEmpty()) {
+        return true;
+    }
+    qsizetype pushed = 0;
+    while (pushed < this->m_overflow.size() && this->m_ring.push(std::move(this->m_overflow[pushed]))) {
+        pushed++;
+    }
+    this->m_overflow.remove(0, pushed);
+    this->m_overflowDepth = this->m_overflow.size();
+    return this->m_overflow.isEmpty();
+}
 
-    PCAPREC_HDR     capHdr = {};
-    TCP_PKT         tcpPkt = {};
+void PacketDumper::processEvent(const DUMP_EVENT &event) {
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    const bool isStream = event.type == DUMP_STREAM_MADE ||
+                          event.type == DUMP_STREAM_DATA ||
+                          event.type == DUMP_STREAM_TEARDOWN;
 
-    const QDateTime now = QDateTime::currentDateTimeUtc();
-    const qint64 msSinceEpoch = now.toMSecsSinceEpoch();
+    if ( this->m_format == CAPTURE_FORMAT_RAW ) {
+        this->processStreamEvent(event, isStream);
+        return;
+    }
 
-    capHdr.ts_sec      = msSinceEpoch / 1000;
-    capHdr.ts_usec     = (msSinceEpoch % 1000) * 1000;
-    capHdr.incl_len    = isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4);
-    capHdr.orig_len    = capHdr.incl_len;
+    const qint64 key = FLOW_KEY(isStream, event.index);
 
-    QByteArray result;
+    // 合并窗口已过的明文先写出, 仍记在轮转前的文件里
+    this->expireCoalesced(event.timestamp);
+    this->rotateIfNeeded(event.timestamp);
 
-    createSynPkt(flow, &tcpPkt);
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    // 写盘持续失败时缓存不超过内存上限
+    const CACHING_ADMIT admit = this->admitCaching();
 
-    createSynAckPkt(flow, &tcpPkt);
-    capHdr.ts_usec += 5;
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    // 同一事件的多条记录依次相隔 FOLLOW_UP_GAP_NS, 下一事件不早于上一事件的最后一条记录
+    const qint64 tsNs = qMax(event.timestamp, this->m_nextTsNs);
 
-    createSynDonePkt(flow, &tcpPkt);
-    capHdr.ts_usec += 5;
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    switch (event.type) {
+    case DUMP_STREAM_MADE: {
+        Q_ASSERT(!this->m_flows.contains(key));
+        event.flow->key = key;
+        this->m_flows.set(key, event.flow);
+        if ( this->m_index.isEnabled() ) {
+            event.flow->index = &this->m_index;
+            this->m_index.describeFlow(*event.flow, tsNs);
+        }
 
-    return result;
+        if ( admit == CACHING_ADMIT_NONE ) {
+            // 不写握手, 但 seq 仍从握手之后开始
+            event.flow->txBytes = 1;
+            event.flow->rxBytes = 1;
+            this->countDrop(*event.flow, 1, 0);
+            break;
+        }
+        this->appendNameResolution(event.flow);
+        this->m_nextTsNs = buildTcpHandshakePkt(this->m_cachingChain, event.flow, tsNs);
+        break;
+    }
+    case DUMP_STREAM_TEARDOWN: {
+        const PoolPtr<FLOW_TRACK> track = this->m_flows.take(key);
+        Q_ASSERT(track);
+
+        this->flushCoalesced(track);
+        if ( admit == CACHING_ADMIT_NONE ) {
+            this->countDrop(*track, 1, 0);
+            this->m_index.endFlow(key, this->m_cachingChain.bytes());
+            break;
+        }
+
+        // pcapng 下被截断或因缓存超限丢过记录的流在 FIN 上注明
+        if ( this->m_format == CAPTURE_FORMAT_PCAPNG ) {
+            QStringList notes;
+            if ( track->truncated[false] || track->truncated[true] ) {
+                notes.append(QStringLiteral("truncated tx=%1 rx=%2 bytes").arg(
+                    QString::number(track->truncated[true]), QString::number(track->truncated[false])));
+            }
+            if ( track->drops ) {
+                notes.append(QStringLiteral("over memory limit %1 records %2 bytes").arg(
+                    QString::number(track->drops), QString::number(track->dropBytes)));
+            }
+            if ( !notes.isEmpty() ) {
+                track->comment = notes.join(QStringLiteral(", ")).toUtf8();
+                track->commentPending = true;
+            }
+        }
+
+        this->m_nextTsNs = buildTcpFinPkt(this->m_cachingChain, track, tsNs, true);
+
+        this->m_index.endFlow(key, this->m_cachingChain.bytes());
+        break;
+    }
+    case DUMP_STREAM_DATA: {
+        const auto *flow = this->m_flows.find(key);
+        Q_ASSERT(flow);
+
+        if ( event.dropped ) {
+            // 队列满时丢弃的字节排在本块之前, 只推进 seq
+            this->flushCoalesced(*flow);
+            dropTcpPayload(*flow, event.dropped, event.sendOut);
+        }
+        if ( this->m_coalesceNs > 0 ) {
+            this->coalescePayload(*flow, event);
+        } else {
+            this->appendStreamPayload(*flow, tsNs, event.payload, event.sendOut, admit);
+        }
+        if ( event.skipped ) {
+            // 截掉的字节排在已合并的明文之后
+            this->flushCoalesced(*flow);
+            skipTcpPayload(*flow, event.skipped, event.sendOut);
+        }
+        break;
+    }
+    case DUMP_DGRAM_MADE:
+        Q_ASSERT(!this->m_flows.contains(key));
+        event.flow->key = key;
+        this->m_flows.set(key, event.flow);
+        if ( this->m_index.isEnabled() ) {
+            event.flow->index = &this->m_index;
+            this->m_index.describeFlow(*event.flow, tsNs);
+        }
+        if ( admit != CACHING_ADMIT_NONE ) {
+            this->appendNameResolution(event.flow);
+        }
+        break;
+    case DUMP_DGRAM_TEARDOWN:
+        Q_ASSERT(this->m_flows.contains(key));
+        this->m_index.endFlow(key, this->m_cachingChain.bytes());
+        this->m_flows.remove(key);
+        return;
+    case DUMP_DGRAM_DATA: {
+        const auto *flow = this->m_flows.find(key);
+        Q_ASSERT(flow);
+
+        if ( event.payload.isEmpty() ) {
+            // 超出预算的数据报
+        } else if ( admit == CACHING_ADMIT_NONE ) {
+            this->countDrop(**flow, 1, event.payload.size());
+        } else {
+            const bool headersOnly = admit == CACHING_ADMIT_HEADERS;
+            if ( headersOnly ) this->countDrop(**flow, 1, event.payload.size());
+            this->m_nextTsNs = buildUdpPayloadPkt(this->m_cachingChain, *flow, tsNs, event.payload, event.sendOut, headersOnly);
+        }
+        (*flow)->truncated[event.sendOut] += event.skipped;
+        break;
+    }
+    }
+
+    this->savePkts(false);
 }
 
+// 原始流模式: 不构建报文, 明文直接交给 StreamDumper
+void PacketDumper::processStreamEvent(const DUMP_EVENT &event, const bool isStream) {
+
+    const auto name = QStringLiteral("%1_%2").arg(isStream ? "tcp" : "udp").arg(event.index, 6, 10, QChar('0'));
+
+    switch (event.type) {
+    case DUMP_STREAM_MADE:
+    case DUMP_DGRAM_MADE:
+        this->m_streams.open(name, *event.flow, event.timestamp);
+        break;
+    case DUMP_STREAM_DATA:
+    case DUMP_DGRAM_DATA:
+        this->m_streams.skip(name, event.sendOut, event.dropped);
+        this->m_streams.append(name, event.sendOut, event.timestamp, event.payload);
+        this->m_streams.skip(name, event.sendOut, event.skipped);
+        break;
+    case DUMP_STREAM_TEARDOWN:
+    case DUMP_DGRAM_TEARDOWN:
+        this->m_streams.close(name, event.timestamp);
+        break;
+    }
 
-// ReSharper disable once CppDFAConstantParameter
-static QByteArray buildTcpFinPkt(const QSharedPointer<FLOW_TRACK> &flow, const bool sendOut) {
+    this->savePkts(false);
+}
 
-    PCAPREC_HDR     capHdr = {};
-    TCP_PKT         tcpPkt = {};
+// pcapng 下把流的 目标地址/域名 写成增量 NRB, 同一组合每个 section 只写一次
+void PacketDumper::appendNameResolution(const PoolPtr<FLOW_TRACK> &flow) {
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    if ( this->m_format != CAPTURE_FORMAT_PCAPNG || flow->domain.isEmpty() ) {
+        return;
+    }
 
-    const QDateTime now = QDateTime::currentDateTimeUtc();
-    const qint64 msSinceEpoch = now.toMSecsSinceEpoch();
+    const QByteArray address(reinterpret_cast<const char *>(flow->dst.ip), flow->isIpv6 ? 16 : 4);
 
-    capHdr.ts_sec      = msSinceEpoch / 1000;
-    capHdr.ts_usec     = (msSinceEpoch % 1000) * 1000;
-    capHdr.incl_len    = isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4);
-    capHdr.orig_len    = capHdr.incl_len;
+    const QByteArray key = address + flow->domain;
+    if ( this->m_resolvedNames.contains(key) ) {
+        return;
+    }
+    this->m_resolvedNames.insert(key);
+
+    static const char padding[4] = {};
+
+    // 记录值为 地址 + 以 0 结尾的域名
+    const unsigned int valueLen = address.size() + flow->domain.size() + 1;
+    const uint32_t totalLen = 2 * sizeof(uint32_t) +
+                              sizeof(PCAPNG_OPTION) + PCAPNG_PAD4(valueLen) +
+                              sizeof(PCAPNG_OPTION) +
+                              sizeof(uint32_t);
+
+    const uint32_t blockHdr[2] = {PCAPNG_BT_NRB, totalLen};
+    const PCAPNG_OPTION record = {
+        static_cast<uint16_t>(flow->isIpv6 ? PCAPNG_NRB_IPV6 : PCAPNG_NRB_IPV4),
+        static_cast<uint16_t>(valueLen)
+    };
+    const PCAPNG_OPTION end = {PCAPNG_NRB_END, 0};
+
+    auto &chain = this->m_cachingChain;
+    const qsizetype start = chain.bytes();
+    chain.beginRecord(flow->key);
+    chain.appendHeader(blockHdr, sizeof(blockHdr));
+    chain.appendHeader(&record, sizeof(record));
+    chain.appendHeader(address.constData(), address.size());
+    chain.appendHeader(flow->domain.constData(), flow->domain.size());
+    chain.appendHeader(padding, 1 + PCAPNG_PAD4(valueLen) - valueLen);
+    chain.appendHeader(&end, sizeof(end));
+    chain.appendHeader(&totalLen, sizeof(totalLen));
+    this->m_index.addRecord(flow->key, start, chain.bytes() - start, 0);
+}
 
-    QByteArray result;
+// 超过大小或时长时切换到下一个文件
+// 只在有新事件时检查, 没有流量时不会产生空文件
+void PacketDumper::rotateIfNeeded(const qint64 timestamp) {
 
-    // 发起方发送FIN
-    createTcpFinPkt(flow, &tcpPkt, sendOut);
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    if ( !this->rotationEnabled() || !this->m_file.isOpen() ) {
+        return;
+    }
 
-    // 接收方收到FIN之后ACK
-    // ReSharper disable once CppDFAConstantConditions
-    createTcpAckPkt(flow, &tcpPkt, !sendOut);
-    capHdr.ts_usec += 5;
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    const bool sizeExceeded = this->m_rotateBytes > 0 &&
+                              this->m_file.size() + this->m_cachingChain.bytes() >= this->m_rotateBytes;
+    const bool timeExceeded = this->m_rotateSeconds > 0 &&
+                              this->m_fileTimer.hasExpired(this->m_rotateSeconds * 1000);
+    if ( !sizeExceeded && !timeExceeded ) {
+        return;
+    }
 
-    // 接收方收到FIN之后FIN
-    // ReSharper disable once CppDFAConstantConditions
-    createTcpFinPkt(flow, &tcpPkt, !sendOut);
-    capHdr.ts_usec += 5;
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    // 先把缓存写入旧文件
+    this->savePkts(true);
+    this->m_file.close();
+    this->countFileLoss(this->m_file.size());
+    this->m_index.close();
+    this->openCaptureFile();
 
-    // 发起方发送ACK
-    createTcpAckPkt(flow, &tcpPkt, sendOut);
-    capHdr.ts_usec += 5;
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+    this->describeLiveFlows(qMax(timestamp, this->m_nextTsNs));
+}
 
-    return result;
+// 新文件或截断后的文件中为仍存活的流补上索引描述, 域名解析, 注释与握手
+void PacketDumper::describeLiveFlows(qint64 tsNs) {
+
+    this->m_resolvedNames.clear();
+    this->m_flows.forEach([this, &tsNs](const qint64 key, const PoolPtr<FLOW_TRACK> &flow) {
+        (void)key;
+        this->m_index.describeFlow(*flow, tsNs);
+        this->appendNameResolution(flow);
+        flow->comment = flow->domain;
+        flow->commentPending = this->m_format == CAPTURE_FORMAT_PCAPNG && !flow->domain.isEmpty();
+        if ( flow->protocol == PROTOCOL_TCP ) {
+            tsNs = buildTcpResumePkt(this->m_cachingChain, flow, tsNs);
+        }
+    });
+    this->m_nextTsNs = tsNs;
 }
 
+// 打开下一个输出文件, 轮转模式下文件名带序号与时间, 超出数量时删除最旧的文件
+// 压缩输出在文件名后追加对应后缀; 打开失败后按退避间隔重试, 期间直接返回 false
+bool PacketDumper::openCaptureFile() {
 
-static QByteArray buildTcpPayloadPkt(const QSharedPointer<FLOW_TRACK> &flow, const char *data, const size_t dataLen, const bool sendOut) {
+    if ( this->m_openRetryMs > 0 && !this->m_openRetryTimer.hasExpired(this->m_openRetryMs) ) {
+        return false;
+    }
 
-    PCAPREC_HDR     capHdr = {};
-    TCP_PKT         tcpPkt = {};
+    const QString codecSuffix = CaptureCodec::suffix(this->m_codec);
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    QString filePath = this->m_pcapFilePath;
+    if ( !codecSuffix.isEmpty() && filePath.endsWith(codecSuffix) ) {
+        filePath.chop(codecSuffix.size());
+    }
 
-    const QDateTime now = QDateTime::currentDateTimeUtc();
-    const qint64 msSinceEpoch = now.toMSecsSinceEpoch();
+    if ( this->rotationEnabled() ) {
+        const QFileInfo info(filePath);
+        const QString suffix = info.suffix().isEmpty() ? QString() : QStringLiteral(".") + info.suffix();
+
+        filePath = QStringLiteral("%1/%2_%3_%4%5").arg(
+            info.absolutePath(),
+            info.completeBaseName(),
+            QStringLiteral("%1").arg(this->m_filesOpened + 1, 5, 10, QChar('0')),
+            QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMddhhmmss")),
+            suffix
+            );
+    }
 
-    capHdr.ts_sec      = msSinceEpoch / 1000;
-    capHdr.ts_usec     = (msSinceEpoch % 1000) * 1000;
-    capHdr.incl_len    = dataLen + (isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
-    capHdr.orig_len    = capHdr.incl_len;
+    filePath += codecSuffix;
 
-    createTcpDataPkt(flow, &tcpPkt, dataLen, sendOut);
+    // 打开成功后才计入轮转, 反复失败时不会挤掉已有的文件
+    if ( !this->m_file.open(filePath, this->m_format, this->m_codec) ) {
+        this->m_openRetryMs = qBound<qint64>(FILE_OPEN_RETRY_MIN_MS, this->m_openRetryMs * 2, FILE_OPEN_RETRY_MAX_MS);
+        this->m_openRetryTimer.restart();
+        return false;
+    }
+    this->m_openRetryMs = 0;
+
+    if ( this->rotationEnabled() ) {
+        this->m_ringFiles.append(filePath);
+        while ( this->m_rotateFiles > 0 && this->m_ringFiles.size() > static_cast<qsizetype>(this->m_rotateFiles) ) {
+            const QString oldest = this->m_ringFiles.takeFirst();
+            QFile::remove(oldest);
+            QFile::remove(CaptureIndex::indexPath(oldest));
+        }
+    }
 
-    QByteArray result;
+    this->m_fileTimer.restart();
+    ++this->m_filesOpened;
 
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
-    result.append(data, static_cast<int>(dataLen));
+    if ( this->m_index.isEnabled() ) {
+        this->m_index.open(filePath, this->m_format, this->m_file.sectionOffset(), this->m_file.appended());
+    }
+    return true;
+}
 
-    // 对方发送ACK
-    createTcpAckPkt(flow, &tcpPkt, !sendOut);
-    capHdr.incl_len    = isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4);
-    capHdr.orig_len    = capHdr.incl_len;
-    capHdr.ts_usec     += 5;
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&tcpPkt), isIpv6 ? sizeof(TCP_PKT_V6) : sizeof(TCP_PKT_V4));
+// io_uring 写盘失败后抓包文件被截断到 fileOffset, 截掉的字节计入丢弃, 索引回退到同一位置
+bool PacketDumper::countFileLoss(const qint64 fileOffset) {
 
-    return result;
+    const qint64 lost = this->m_file.takeLostBytes();
+    if ( lost <= 0 ) {
+        return false;
+    }
+    this->m_dropBytes += lost;
+    this->m_index.rollback(fileOffset);
+    return true;
 }
 
-static QByteArray buildUdpPayloadPkt(const QSharedPointer<FLOW_TRACK> &flow, const char *data, const size_t dataLen, const bool sendOut) {
+void PacketDumper::writerRoutine() {
 
-    PCAPREC_HDR     capHdr = {};
-    UDP_PKT         udpPkt = {};
+    while (true) {
+        // 先判断退出标志, 保证置位之前投递的事件都能被处理
+        const bool stopping = this->m_stopping;
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+        bool idle = true;
+        while (auto event = this->m_ring.pop()) {
+            this->processEvent(event.value());
+            idle = false;
+        }
+
+        if (stopping) break;
+
+        if (idle) {
+            // 没有新数据时也要按时写出合并中的明文并刷盘
+            this->expireCoalesced(CaptureClock::nowNs());
+            this->savePkts(false);
+            std::this_thread::sleep_for(std::chrono::milliseconds(DUMP_WRITER_IDLE_MS));
+        }
+    }
 
-    const QDateTime now = QDateTime::currentDateTimeUtc();
-    const qint64 msSinceEpoch = now.toMSecsSinceEpoch();
+    this->expireCoalesced(std::numeric_limits<qint64>::max());
+    this->savePkts(true);
+}
 
-    capHdr.ts_sec      = msSinceEpoch / 1000;
-    capHdr.ts_usec     = (msSinceEpoch % 1000) * 1000;
-    capHdr.incl_len    = dataLen + (isIpv6 ? sizeof(UDP_PKT_V6) : sizeof(UDP_PKT_V4));
-    capHdr.orig_len    = capHdr.incl_len;
 
-    createUdpDataPkt(flow, &udpPkt, dataLen, sendOut);
+void PacketDumper::savePkts(const bool flush) {
 
-    QByteArray result;
+    // 原始流模式只需按时把 QFile 缓冲刷到磁盘
+    if ( this->m_format == CAPTURE_FORMAT_RAW ) {
+        if ( flush || this->timerExpired() ) {
+            this->m_streams.flush();
+        }
+        return;
+    }
 
-    result.append(reinterpret_cast<const char *>(&capHdr), sizeof(PCAPREC_HDR));
-    result.append(reinterpret_cast<const char *>(&udpPkt), isIpv6 ? sizeof(UDP_PKT_V6) : sizeof(UDP_PKT_V4));
-    result.append(data, static_cast<int>(dataLen));
+    if ( this->m_cachingChain.isEmpty() ) {
+        this->m_cachingBytesLen = 0;
+        return ;
+    }
 
-    return result;
+    if ( !this->m_pcapFilePath.isEmpty() ) {
+        if ( this->m_cachingChain.bytes() >= CACHING_BUFFER_MAX_BYTES || flush || this->timerExpired() ) {
+
+            QElapsedTimer elapsed;
+            elapsed.start();
+
+            if ( !this->m_file.isOpen() ) {
+                this->openCaptureFile();
+            }
+            // 失败时未写出的记录留在缓存中, 下次再试
+            // 写出的部分位于文件末尾; io_uring 失败回退后起点会早于写之前的长度
+            const qsizetype pending = this->m_cachingChain.bytes();
+            const bool result = this->m_file.write(this->m_cachingChain);
+            const qsizetype written = pending - this->m_cachingChain.bytes();
+            const qint64 fileOffset = this->m_file.size() - written;
+            const bool truncated = this->countFileLoss(fileOffset);
+            this->m_index.commit(fileOffset, written);
+            this->m_index.settle(this->m_file.durableSize());
+            if ( !result && this->m_codec != CAPTURE_CODEC_NONE && this->m_file.isOpen() ) {
+                // 压缩帧写失败后无法续写, 整条链计入丢弃
+                this->m_drops += this->m_cachingChain.begunRecords();
+                this->m_dropBytes += this->m_cachingChain.bytes();
+                this->m_cachingChain.clear();
+                this->m_index.discardPending();
+            }
+            if ( truncated ) {
+                // 截掉部分中登记的流描述已随索引回退, 随下次写盘补上
+                this->describeLiveFlows(this->m_nextTsNs);
+            }
+
+            const unsigned long long us = elapsed.nsecsElapsed() / 1000;
+            this->m_writeLatencyUs = us;
+            if (us > this->m_writeLatencyMaxUs)
+                this->m_writeLatencyMaxUs = us;
+        }
+    }
+
+    this->m_cachingBytesLen = this->m_cachingChain.bytes();
 }
 
+// 按内存上限与策略决定本事件的记录如何进入缓存
+// 只在写盘失败或没有输出路径时缓存才会涨到上限, 单个事件的记录可能略微越过上限
+PacketDumper::CACHING_ADMIT PacketDumper::admitCaching() {
 
+    if ( this->m_cachingLimit <= 0 ) return CACHING_ADMIT_FULL;
 
-static void createEthernetHeader(ETHERNET_HEADER *ethernet, const bool sendOut, const bool isIpv6) {
+    const qint64 pending = this->m_cachingChain.bytes();
+    const qint64 lowWater = CACHING_LOW_WATER(this->m_cachingLimit);
 
-    static unsigned char fake_src_mac[MAC_ADDRESS_LEN] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60};
-    static unsigned char fake_dst_mac[MAC_ADDRESS_LEN] = {0xf0, 0xe0, 0xd0, 0xc0, 0xb0, 0xa0};
+    switch ( this->m_dropPolicy ) {
+    case DUMP_DROP_NEWEST:
+        return pending >= this->m_cachingLimit ? CACHING_ADMIT_NONE : CACHING_ADMIT_FULL;
+    case DUMP_DROP_METADATA:
+        if ( pending >= this->m_cachingLimit ) return CACHING_ADMIT_NONE;
+        return pending >= lowWater ? CACHING_ADMIT_HEADERS : CACHING_ADMIT_FULL;
+    case DUMP_DROP_OLDEST:
+        break;
+    }
 
-    if ( sendOut ) {
-        memcpy(ethernet->src_mac, fake_src_mac, MAC_ADDRESS_LEN);
-        memcpy(ethernet->dst_mac, fake_dst_mac, MAC_ADDRESS_LEN);
-    } else {
-        memcpy(ethernet->src_mac, fake_dst_mac, MAC_ADDRESS_LEN);
-        memcpy(ethernet->dst_mac, fake_src_mac, MAC_ADDRESS_LEN);
+    if ( pending < this->m_cachingLimit ) return CACHING_ADMIT_FULL;
+
+    // 连续丢弃的记录多属于同一个流, 合并后再查找流
+    qint64 lastKey = -1;
+    unsigned int records = 0;
+    qint64 bytes = 0;
+    const auto settle = [this, &lastKey, &records, &bytes]() {
+        if ( !records ) return;
+        const auto *flow = lastKey >= 0 ? this->m_flows.find(lastKey) : nullptr;
+        if ( flow ) {
+            this->countDrop(**flow, records, bytes);
+        } else {
+            // 流已结束, 只计入总数
+            this->m_drops += records;
+            this->m_dropBytes += bytes;
+        }
+        records = 0;
+        bytes = 0;
+    };
+    qsizetype droppedRecords = 0;
+    const qsizetype freed = this->m_cachingChain.dropFront(pending - lowWater, [&](const qint64 tag, const qsizetype len) {
+        if ( tag != lastKey ) {
+            settle();
+            lastKey = tag;
+        }
+        records++;
+        bytes += len;
+        droppedRecords++;
+    });
+    settle();
+    this->m_index.dropPending(droppedRecords, freed);
+
+    // 首条记录写出了一部分时无法丢弃, 仍超限则丢弃新记录
+    return this->m_cachingChain.bytes() >= this->m_cachingLimit ? CACHING_ADMIT_NONE : CACHING_ADMIT_FULL;
+}
+
+void PacketDumper::countDrop(FLOW_TRACK &flow, const unsigned int records, const qint64 bytes) {
+
+    if ( !flow.drops ) ++this->m_dropFlows;
+    flow.drops += records;
+    flow.dropBytes += bytes;
+    this->m_drops += records;
+    this->m_dropBytes += bytes;
+}
+
+// 按缓存准入切分写出一段 TCP 明文, 不能进入缓存时只推进 seq
+void PacketDumper::appendStreamPayload(const PoolPtr<FLOW_TRACK> &flow, const qint64 timestamp, const QByteArray &payload,
+                                       const bool sendOut, const CACHING_ADMIT admit) {
+
+    if ( admit == CACHING_ADMIT_NONE ) {
+        // 整块丢弃, 只推进 seq
+        this->countDrop(*flow, 1, payload.size());
+        dropTcpPayload(flow, payload.size(), sendOut);
+        return;
     }
 
-    if (isIpv6) {
-        ethernet->type = htons_u(ETHERNET_FRAME_IPv6);
+    const bool headersOnly = admit == CACHING_ADMIT_HEADERS;
+    if ( headersOnly ) this->countDrop(*flow, 1, payload.size());
+    const qint64 tsNs = qMax(timestamp, this->m_nextTsNs);
+    this->m_nextTsNs = buildTcpPayloadPkt(this->m_cachingChain, flow, tsNs, payload, sendOut, headersOnly);
+}
+
+// 同方向的小块明文先并入流的合并缓冲, 方向改变, 超过字节上限或时间窗口时整体切分写出
+// 合并后的报文段取第一块的时间戳
+void PacketDumper::coalescePayload(const PoolPtr<FLOW_TRACK> &flow, const DUMP_EVENT &event) {
+
+    const qsizetype len = event.payload.size();
+    if ( len <= 0 ) return;
+
+    const qsizetype limit = this->m_coalesceBytes > 0 ? this->m_coalesceBytes : flow->mss;
+    if ( !flow->coalesced.isEmpty() && (flow->coalescedSendOut != event.sendOut ||
+                                        event.timestamp - flow->coalescedTsNs >= this->m_coalesceNs ||
+                                        flow->coalesced.size() + len > limit) ) {
+        this->flushCoalesced(flow);
+    }
+
+    // 本身已够大的块不经过缓冲
+    if ( len >= limit ) {
+        this->appendStreamPayload(flow, event.timestamp, event.payload, event.sendOut, this->admitCaching());
+        return;
+    }
+
+    if ( flow->coalesced.isEmpty() ) {
+        flow->coalesced = event.payload;
+        flow->coalescedSendOut = event.sendOut;
+        flow->coalescedTsNs = event.timestamp;
+        this->m_coalescing.enqueue(qMakePair(flow, event.timestamp));
     } else {
-        ethernet->type = htons_u(ETHERNET_FRAME_IP);
+        flow->coalesced.append(event.payload);
+        ++this->m_coalescedChunks;
+    }
+
+    if ( flow->coalesced.size() >= limit ) {
+        this->flushCoalesced(flow);
     }
 }
 
-// ReSharper disable once CppDFAConstantParameter
-static void createIpHeader(IP_HEADER *ipHdr, const QSharedPointer<FLOW_TRACK> &flow, const unsigned int payloadLen, const bool sendOut) {
+void PacketDumper::flushCoalesced(const PoolPtr<FLOW_TRACK> &flow) {
 
-    static unsigned short fake_src_ip_id = 0x0010;
-    static unsigned short fake_dst_ip_id = 0x00a0;
+    if ( flow->coalesced.isEmpty() ) return;
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    const QByteArray payload = std::move(flow->coalesced);
+    flow->coalesced = QByteArray();
+    this->appendStreamPayload(flow, flow->coalescedTsNs, payload, flow->coalescedSendOut, this->admitCaching());
+}
 
-    if (isIpv6) {
-        ipHdr->ipv6.ver_tc_flow     = htonl_u((6 << 28) | (0 << 20) | 0); // version=6, traffic class=0, flow label=0
-        ipHdr->ipv6.payload_length  = htons_u(payloadLen);              // 不包括IPv6头部，单位为字节
-        ipHdr->ipv6.next_header     = flow->protocol;                    // 通常是 TCP(6) 或 UDP(17)
-        ipHdr->ipv6.hop_limit       = 90;                               // 类似TTL
+// 写出开始合并早于 nowNs 一个窗口的流, 提前写出过的流在队列里的旧条目直接跳过
+void PacketDumper::expireCoalesced(const qint64 nowNs) {
 
-        const auto [s] = sendOut ? flow->srcIp.toIPv6Address() : flow->dstIp.toIPv6Address();
-        const auto [d] = sendOut ? flow->dstIp.toIPv6Address() : flow->srcIp.toIPv6Address();
+    while ( !this->m_coalescing.isEmpty() ) {
+        if ( this->m_coalescing.head().second > nowNs - this->m_coalesceNs ) break;
 
-        memcpy(ipHdr->ipv6.src_ip, &s, sizeof(Q_IPV6ADDR));
-        memcpy(ipHdr->ipv6.dst_ip, &d, sizeof(Q_IPV6ADDR));
-    } else {
-        ipHdr->ipv4.hdr_len    = 5;
-        ipHdr->ipv4.ver        = 4;
-        ipHdr->ipv4.tos        = 0;
-        ipHdr->ipv4.flags      = 0x0000;
-        ipHdr->ipv4.ttl        = 90;
-        ipHdr->ipv4.protocol   = flow->protocol;
+        const auto entry = this->m_coalescing.dequeue();
+        if ( entry.first->coalescedTsNs == entry.second ) {
+            this->flushCoalesced(entry.first);
+        }
+    }
+}
 
-        ipHdr->ipv4.id = sendOut ? fake_src_ip_id : fake_dst_ip_id;
-        sendOut ? fake_src_ip_id++ : fake_dst_ip_id++;
+bool PacketDumper::timerExpired() {
+    bool result = false;
+    if (this->m_lastRefreshTimer.hasExpired(FILE_FLUSH_INTERVAL_MS)) {
+        this->m_lastRefreshTimer.restart();
+        result = true;
+    }
+    return result;
+}
 
-        ipHdr->ipv4.src_ip = sendOut ? flow->srcIp.toIPv4Address() : flow->dstIp.toIPv4Address();
-        ipHdr->ipv4.dst_ip = sendOut ? flow->dstIp.toIPv4Address() : flow->srcIp.toIPv4Address();
 
-        ipHdr->ipv4.total_len = htons_u(payloadLen + sizeof(IP_HEADER_V4));
-        ipHdr->ipv4.checksum = 0;
+// 地址族相关的报文布局, 每包路径按地址族在编译期特化
+struct IPV4_FAMILY {
+    typedef TCP_PKT_V4 TcpPkt;
+    typedef UDP_PKT_V4 UdpPkt;
+
+    static void patchIpHeader(IP_HEADER_V4 *ipHdr, const unsigned int payloadLen, const unsigned short id) {
+        ipHdr->total_len = htons_u(payloadLen + sizeof(IP_HEADER_V4));
+        ipHdr->id = htons_u(id);
     }
-}
 
-static void createTcpHeader(TCP_HEADER *tcpHdr, const QSharedPointer<FLOW_TRACK> &flow, const unsigned char flags, const bool sendOut) {
+    // 模板部分和加上本包的长度与标识
+    static void fillIpChecksum(IP_HEADER_V4 *ipHdr, const uint64_t seed) {
+        ipHdr->checksum = Checksum::finish(seed + ipHdr->total_len + ipHdr->id);
+    }
 
-    tcpHdr->src_port = sendOut ? htons_u(flow->srcPort) : htons_u(flow->dstPort);
-    tcpHdr->dst_port = sendOut ? htons_u(flow->dstPort) : htons_u(flow->srcPort);
+    // 伪首部中的源与目的地址
+    static uint64_t pseudoSeed(const IP_HEADER_V4 *ipHdr) {
+        return Checksum::partial(reinterpret_cast<const char *>(ipHdr) + offsetof(IP_HEADER_V4, src_ip), 8);
+    }
+};
 
-    tcpHdr->seq_num = 0;
-    tcpHdr->ack_num = 0;
+struct IPV6_FAMILY {
+    typedef TCP_PKT_V6 TcpPkt;
+    typedef UDP_PKT_V6 UdpPkt;
 
-    tcpHdr->unused = 0;
-    tcpHdr->hdr_len = 5; // 5个双字 标准20字节头
+    static void patchIpHeader(IP_HEADER_V6 *ipHdr, const unsigned int payloadLen, const unsigned short id) {
+        (void)id;
+        ipHdr->payload_length = htons_u(payloadLen);
+    }
 
-    tcpHdr->flags = flags;
-    tcpHdr->wnd_size = htons_u(0x8000u);
+    // IPv6 头没有校验和
+    static void fillIpChecksum(IP_HEADER_V6 *ipHdr, const uint64_t seed) {
+        (void)ipHdr;
+        (void)seed;
+    }
 
-    tcpHdr->checksum = 0;
-    tcpHdr->urg_pointer = 0;
+    static uint64_t pseudoSeed(const IP_HEADER_V6 *ipHdr) {
+        return Checksum::partial(ipHdr->src_ip, 32);
+    }
+};
+
+// 校验和模式: 伪首部与 TCP/UDP 头中的固定字段在连接建立时按模板累加好
+// 每包只累加长度, seq/ack, 标志位与数据本身
+template<typename F>
+static void fillTcpChecksums(const FLOW_TRACK &flow, typename F::TcpPkt &pkt, const char *data, const qsizetype len) {
+
+    F::fillIpChecksum(&pkt.ip_hdr, flow.ipCsumSeed);
+
+    uint64_t sum = flow.l4CsumSeed + htons_u(sizeof(TCP_HEADER) + len);
+    sum += pkt.tcp_hdr.seq_num;
+    sum += pkt.tcp_hdr.ack_num;
+    sum += htons_u(pkt.tcp_hdr.flags);
+    pkt.tcp_hdr.checksum = Checksum::finish(Checksum::partial(data, len, sum));
 }
 
-static void createUdpHeader(UDP_HEADER *udpHdr, const QSharedPointer<FLOW_TRACK> &flow, const unsigned int payloadLen, const bool sendOut) {
+template<typename F>
+static void fillUdpChecksums(const FLOW_TRACK &flow, typename F::UdpPkt &pkt, const char *data, const qsizetype len) {
 
-    udpHdr->src_port = sendOut ? htons_u(flow->srcPort) : htons_u(flow->dstPort);
-    udpHdr->dst_port = sendOut ? htons_u(flow->dstPort) : htons_u(flow->srcPort);
+    F::fillIpChecksum(&pkt.ip_hdr, flow.ipCsumSeed);
 
-    udpHdr->udp_len = htons_u(payloadLen + sizeof(UDP_HEADER));
-    udpHdr->checksum = 0;
+    // 伪首部与 UDP 头各有一个长度
+    const uint64_t sum = flow.l4CsumSeed + 2ull * pkt.udp_hdr.udp_len;
+    const uint16_t checksum = Checksum::finish(Checksum::partial(data, len, sum));
+    // 0 表示未计算校验和, 按 RFC 768 写成全 1
+    pkt.udp_hdr.checksum = checksum ? checksum : 0xFFFF;
 }
 
-static void createSynPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt) {
+// 输出格式相关的记录封装, 与地址族一样在编译期特化
+// 报文头进入 arena, 明文数据只在链中保留引用
+struct PCAP_WRITER {
+    static void appendRecord(RecordChain &chain, FLOW_TRACK &flow, const qint64 tsNs,
+                             const void *pkt, unsigned int pktLen,
+                             const QByteArray &payload, const qsizetype offset, const qsizetype len,
+                             const bool headersOnly = false) {
+
+        pkt = static_cast<const char *>(pkt) + flow.linkSkip();
+        pktLen -= flow.linkSkip();
+
+        PCAPREC_HDR capHdr = {};
+        capHdr.ts_sec      = tsNs / 1000000000;
+        capHdr.ts_usec     = (tsNs % 1000000000) / 1000;
+        capHdr.incl_len    = pktLen + (headersOnly ? 0 : len);
+        capHdr.orig_len    = pktLen + len;
+
+        const qsizetype start = chain.bytes();
+        chain.beginRecord(flow.key);
+        chain.appendHeader(&capHdr, sizeof(PCAPREC_HDR));
+        chain.appendHeader(pkt, pktLen);
+        if ( !headersOnly ) chain.appendPayload(payload, offset, len);
+        if ( flow.index ) flow.index->addRecord(flow.key, start, chain.bytes() - start, tsNs);
+    }
+};
 
-    constexpr bool send_out = true;
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+struct PCAPNG_WRITER {
+    static void appendRecord(RecordChain &chain, FLOW_TRACK &flow, const qint64 tsNs,
+                             const void *pkt, unsigned int pktLen,
+                             const QByteArray &payload, const qsizetype offset, const qsizetype len,
+                             const bool headersOnly = false) {
 
-    if (isIpv6) {
-        createEthernetHeader(&tcpPkt->tcpv6.eth_hdr, send_out, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv6.ip_hdr), flow, sizeof(TCP_HEADER), send_out);
-        createTcpHeader(&tcpPkt->tcpv6.tcp_hdr, flow, TCP_SYN_FLAG, send_out);
+        static const char padding[4] = {};
 
-        tcpPkt->tcpv6.tcp_hdr.seq_num = 0;
-        tcpPkt->tcpv6.tcp_hdr.ack_num = 0;
-    } else {
-        createEthernetHeader(&tcpPkt->tcpv4.eth_hdr, send_out, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv4.ip_hdr), flow, sizeof(TCP_HEADER), send_out);
-        createTcpHeader(&tcpPkt->tcpv4.tcp_hdr, flow, TCP_SYN_FLAG, send_out);
+        pkt = static_cast<const char *>(pkt) + flow.linkSkip();
+        pktLen -= flow.linkSkip();
+
+        // 只保留报文头时按快照截断处理, 原始长度仍为完整报文
+        const unsigned int capLen = pktLen + (headersOnly ? 0 : len);
+
+        // 流的第一个报文用 opt_comment 记录目标域名, 截断的流在最后一个报文上记录被截掉的字节数
+        const bool comment = flow.commentPending;
+        flow.commentPending = false;
+
+        unsigned int optLen = 0;
+        if ( comment ) {
+            optLen = sizeof(PCAPNG_OPTION) + PCAPNG_PAD4(flow.comment.size()) + sizeof(PCAPNG_OPTION);
+        }
 
-        tcpPkt->tcpv4.tcp_hdr.seq_num = 0;
-        tcpPkt->tcpv4.tcp_hdr.ack_num = 0;
+        const uint32_t totalLen = sizeof(PCAPNG_EPB) + PCAPNG_PAD4(capLen) + optLen + sizeof(uint32_t);
+
+        PCAPNG_EPB epb = {};
+        epb.block_type          = PCAPNG_BT_EPB;
+        epb.block_total_length  = totalLen;
+        epb.interface_id        = 0;
+        epb.ts_high             = static_cast<uint64_t>(tsNs) >> 32u;
+        epb.ts_low              = static_cast<uint64_t>(tsNs) & 0xffffffffu;
+        epb.captured_len        = capLen;
+        epb.orig_len            = pktLen + len;
+
+        const qsizetype start = chain.bytes();
+        chain.beginRecord(flow.key);
+        chain.appendHeader(&epb, sizeof(epb));
+        chain.appendHeader(pkt, pktLen);
+        if ( !headersOnly ) chain.appendPayload(payload, offset, len);
+        chain.appendHeader(padding, PCAPNG_PAD4(capLen) - capLen);
+
+        if ( comment ) {
+            PCAPNG_OPTION opt = {PCAPNG_OPT_COMMENT, static_cast<uint16_t>(flow.comment.size())};
+            chain.appendHeader(&opt, sizeof(opt));
+            chain.appendPayload(flow.comment);
+            chain.appendHeader(padding, PCAPNG_PAD4(flow.comment.size()) - flow.comment.size());
+
+            opt = {PCAPNG_OPT_ENDOFOPT, 0};
+            chain.appendHeader(&opt, sizeof(opt));
+        }
+
+        chain.appendHeader(&totalLen, sizeof(totalLen));
+        if ( flow.index ) flow.index->addRecord(flow.key, start, chain.bytes() - start, tsNs);
     }
+};
+
+typedef struct PKT_BUILDER_ {
+    qint64 (*tcpHandshake)(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs);
+    qint64 (*tcpResume)(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs);
+    qint64 (*tcpFin)(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs, bool sendOut);
+    qint64 (*tcpPayload)(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs, const QByteArray &payload, bool sendOut, bool headersOnly);
+    qint64 (*udpPayload)(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs, const QByteArray &payload, bool sendOut, bool headersOnly);
+} PKT_BUILDER;
+
+// 同一事件产生的多条记录之间的时间间隔, 取 pcap 微秒时间戳能区分的最小值
+#define FOLLOW_UP_GAP_NS        1000
+
 
-    flow->rxBytes = 0;
-    flow->txBytes = 1;
+// 复制模板后只修改长度, IP标识, 标志位与 seq/ack
+template<typename F, typename W>
+static void appendTcpRecord(RecordChain &chain, FLOW_TRACK &flow, const qint64 tsNs, const unsigned char flags,
+                            const QByteArray &payload, const bool sendOut) {
 
+    typename F::TcpPkt tcpPkt;
+    memcpy(&tcpPkt, &flow.hdrTmpl[sendOut].tcp, sizeof(tcpPkt));
+
+    F::patchIpHeader(&tcpPkt.ip_hdr, sizeof(TCP_HEADER) + payload.size(), flow.ipId[sendOut]++);
+    tcpPkt.tcp_hdr.flags   = flags;
+    tcpPkt.tcp_hdr.seq_num = sendOut ? TCP_SEQ(flow.txBytes) : TCP_SEQ(flow.rxBytes);
+    tcpPkt.tcp_hdr.ack_num = sendOut ? TCP_SEQ(flow.rxBytes) : TCP_SEQ(flow.txBytes);
+    if ( flow.checksums ) fillTcpChecksums<F>(flow, tcpPkt, payload.constData(), payload.size());
+
+    W::appendRecord(chain, flow, tsNs, &tcpPkt, sizeof(tcpPkt), payload, 0, payload.size());
 }
 
-static void createSynAckPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt) {
+// 以当前 seq/ack 减一作为 ISN 写出三次握手, 握手结束后恰好回到当前 seq/ack
+template<typename F, typename W>
+static qint64 appendTcpHandshake(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs) {
 
-    constexpr bool send_out = false;
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    flow.txBytes--;
+    flow.rxBytes--;
 
-    if (isIpv6) {
-        createEthernetHeader(&tcpPkt->tcpv6.eth_hdr, send_out, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv6.ip_hdr), flow, sizeof(TCP_HEADER), send_out);
-        createTcpHeader(&tcpPkt->tcpv6.tcp_hdr, flow, TCP_SYN_FLAG | TCP_ACK_FLAG, send_out);
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_SYN_FLAG, QByteArray(), true);
+    flow.txBytes++;
 
-        tcpPkt->tcpv6.tcp_hdr.seq_num = htonl_u(flow->rxBytes);
-        tcpPkt->tcpv6.tcp_hdr.ack_num = htonl_u(flow->txBytes);
-    } else {
-        createEthernetHeader(&tcpPkt->tcpv4.eth_hdr, send_out, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv4.ip_hdr), flow, sizeof(TCP_HEADER), send_out);
-        createTcpHeader(&tcpPkt->tcpv4.tcp_hdr, flow, TCP_SYN_FLAG | TCP_ACK_FLAG, send_out);
+    tsNs += FOLLOW_UP_GAP_NS;
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_SYN_FLAG | TCP_ACK_FLAG, QByteArray(), false);
+    flow.rxBytes++;
 
-        tcpPkt->tcpv4.tcp_hdr.seq_num = htonl_u(flow->rxBytes);
-        tcpPkt->tcpv4.tcp_hdr.ack_num = htonl_u(flow->txBytes);
-    }
-    flow->rxBytes++;
+    tsNs += FOLLOW_UP_GAP_NS;
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_ACK_FLAG, QByteArray(), true);
+
+    return tsNs + FOLLOW_UP_GAP_NS;
 }
 
-static void createSynDonePkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt) {
+template<typename F, typename W>
+static qint64 buildTcpHandshakePktT(RecordChain &chain, FLOW_TRACK &flow, const qint64 tsNs) {
 
-    constexpr bool sendOut = true;
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    // 新连接 ISN 为 0
+    flow.rxBytes = 1;
+    flow.txBytes = 1;
 
-    if (isIpv6) {
-        createEthernetHeader(&tcpPkt->tcpv6.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv6.ip_hdr), flow, sizeof(TCP_HEADER), sendOut);
-        createTcpHeader(&tcpPkt->tcpv6.tcp_hdr, flow, TCP_ACK_FLAG, sendOut);
+    return appendTcpHandshake<F, W>(chain, flow, tsNs);
+}
 
-        tcpPkt->tcpv6.tcp_hdr.seq_num = htonl_u(flow->txBytes);
-        tcpPkt->tcpv6.tcp_hdr.ack_num = htonl_u(flow->rxBytes);
-    } else {
-        createEthernetHeader(&tcpPkt->tcpv4.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv4.ip_hdr), flow, sizeof(TCP_HEADER), sendOut);
-        createTcpHeader(&tcpPkt->tcpv4.tcp_hdr, flow, TCP_ACK_FLAG, sendOut);
+// 切换文件时为仍存活的流补一次握手, 新文件可以独立解析
+template<typename F, typename W>
+static qint64 buildTcpResumePktT(RecordChain &chain, FLOW_TRACK &flow, const qint64 tsNs) {
 
-        tcpPkt->tcpv4.tcp_hdr.seq_num = htonl_u(flow->txBytes);
-        tcpPkt->tcpv4.tcp_hdr.ack_num = htonl_u(flow->rxBytes);
-    }
+    return appendTcpHandshake<F, W>(chain, flow, tsNs);
 }
 
-static void createTcpAckPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt, const bool sendOut) {
+template<typename F, typename W>
+static qint64 buildTcpFinPktT(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs, const bool sendOut) {
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    // 发起方发送FIN
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_FIN_FLAG, QByteArray(), sendOut);
+    sendOut ? flow.txBytes++ : flow.rxBytes++;
 
-    if (isIpv6) {
-        createEthernetHeader(&tcpPkt->tcpv6.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv6.ip_hdr), flow, sizeof(TCP_HEADER), sendOut);
-        createTcpHeader(&tcpPkt->tcpv6.tcp_hdr, flow, TCP_ACK_FLAG, sendOut);
+    // 接收方收到FIN之后ACK
+    tsNs += FOLLOW_UP_GAP_NS;
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_ACK_FLAG, QByteArray(), !sendOut);
 
-        tcpPkt->tcpv6.tcp_hdr.seq_num = sendOut ? htonl_u(flow->txBytes) : htonl_u(flow->rxBytes);
-        tcpPkt->tcpv6.tcp_hdr.ack_num = sendOut ? htonl_u(flow->rxBytes) : htonl_u(flow->txBytes);
-    } else {
-        createEthernetHeader(&tcpPkt->tcpv4.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv4.ip_hdr), flow, sizeof(TCP_HEADER), sendOut);
-        createTcpHeader(&tcpPkt->tcpv4.tcp_hdr, flow, TCP_ACK_FLAG, sendOut);
+    // 接收方收到FIN之后FIN
+    tsNs += FOLLOW_UP_GAP_NS;
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_FIN_FLAG, QByteArray(), !sendOut);
+    !sendOut ? flow.txBytes++ : flow.rxBytes++;
 
-        tcpPkt->tcpv4.tcp_hdr.seq_num = sendOut ? htonl_u(flow->txBytes) : htonl_u(flow->rxBytes);
-        tcpPkt->tcpv4.tcp_hdr.ack_num = sendOut ? htonl_u(flow->rxBytes) : htonl_u(flow->txBytes);
+    // 发起方发送ACK
+    tsNs += FOLLOW_UP_GAP_NS;
+    appendTcpRecord<F, W>(chain, flow, tsNs, TCP_ACK_FLAG, QByteArray(), sendOut);
+
+    return tsNs + FOLLOW_UP_GAP_NS;
+}
+
+// 明文按 MSS 切分为多个报文段, seq 逐段推进, 每 TCP_ACK_EVERY_SEGMENTS 段与最后一段之后对方回一个 ACK
+// 两个方向的模板各只复制一次, 每段只改长度, IP标识与 seq/ack, 数据段只引用 payload 的切片
+template<typename F, typename W>
+static qint64 buildTcpPayloadPktT(RecordChain &chain, FLOW_TRACK &flow, qint64 tsNs, const QByteArray &payload, const bool sendOut,
+                                const bool headersOnly) {
+
+    const qsizetype total = payload.size();
+    if ( total <= 0 ) return tsNs;
+
+    const qsizetype mss = flow.mss;
+    const qsizetype segments = (total + mss - 1) / mss;
+    const qsizetype acks = flow.lean ? 0 : (segments + TCP_ACK_EVERY_SEGMENTS - 1) / TCP_ACK_EVERY_SEGMENTS;
+    // 每条记录最多 6 段: 记录头, 报文头, 数据, 填充, 块尾长度, 以及可能的注释
+    chain.reserve((segments + acks) * (sizeof(PCAPNG_EPB) + sizeof(typename F::TcpPkt) + 8), (segments + acks) * 6);
+
+    uint64_t &seq = sendOut ? flow.txBytes : flow.rxBytes;
+    const uint64_t peerSeq = sendOut ? flow.rxBytes : flow.txBytes;
+
+    typename F::TcpPkt dataPkt;
+    memcpy(&dataPkt, &flow.hdrTmpl[sendOut].tcp, sizeof(dataPkt));
+    dataPkt.tcp_hdr.flags   = TCP_PSH_FLAG | TCP_ACK_FLAG;
+    dataPkt.tcp_hdr.ack_num = TCP_SEQ(peerSeq);
+
+    typename F::TcpPkt ackPkt;
+    memcpy(&ackPkt, &flow.hdrTmpl[!sendOut].tcp, sizeof(ackPkt));
+    ackPkt.tcp_hdr.flags    = TCP_ACK_FLAG;
+    ackPkt.tcp_hdr.seq_num  = TCP_SEQ(peerSeq);
+
+    qsizetype offset = 0;
+    for ( qsizetype i = 1; offset < total; i++ ) {
+        const qsizetype len = qMin(mss, total - offset);
+
+        F::patchIpHeader(&dataPkt.ip_hdr, sizeof(TCP_HEADER) + len, flow.ipId[sendOut]++);
+        dataPkt.tcp_hdr.seq_num = TCP_SEQ(seq);
+        if ( flow.checksums ) fillTcpChecksums<F>(flow, dataPkt, payload.constData() + offset, len);
+        W::appendRecord(chain, flow, tsNs, &dataPkt, sizeof(dataPkt), payload, offset, len, headersOnly);
+
+        seq += len;
+        offset += len;
+        tsNs += FOLLOW_UP_GAP_NS;
+
+        // 对方发送ACK, 精简模式下由对方之后报文中的 ack 确认
+        if ( !flow.lean && (i % TCP_ACK_EVERY_SEGMENTS == 0 || offset == total) ) {
+            F::patchIpHeader(&ackPkt.ip_hdr, sizeof(TCP_HEADER), flow.ipId[!sendOut]++);
+            ackPkt.tcp_hdr.ack_num = TCP_SEQ(seq);
+            if ( flow.checksums ) fillTcpChecksums<F>(flow, ackPkt, nullptr, 0);
+            W::appendRecord(chain, flow, tsNs, &ackPkt, sizeof(ackPkt), QByteArray(), 0, 0);
+            tsNs += FOLLOW_UP_GAP_NS;
+        }
     }
+    return tsNs;
 }
 
-static void createTcpFinPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt, const bool sendOut) {
+template<typename F, typename W>
+static qint64 buildUdpPayloadPktT(RecordChain &chain, FLOW_TRACK &flow, const qint64 tsNs, const QByteArray &payload, const bool sendOut,
+                                const bool headersOnly) {
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+    const unsigned int dataLen = payload.size();
 
-    if (isIpv6) {
-        createEthernetHeader(&tcpPkt->tcpv6.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv6.ip_hdr), flow, sizeof(TCP_HEADER), sendOut);
-        createTcpHeader(&tcpPkt->tcpv6.tcp_hdr, flow, TCP_FIN_FLAG, sendOut);
+    typename F::UdpPkt udpPkt;
+    memcpy(&udpPkt, &flow.hdrTmpl[sendOut].udp, sizeof(udpPkt));
 
-        tcpPkt->tcpv6.tcp_hdr.seq_num = sendOut ? htonl_u(flow->txBytes) : htonl_u(flow->rxBytes);
-        tcpPkt->tcpv6.tcp_hdr.ack_num = sendOut ? htonl_u(flow->rxBytes) : htonl_u(flow->txBytes);
-    } else {
-        createEthernetHeader(&tcpPkt->tcpv4.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv4.ip_hdr), flow, sizeof(TCP_HEADER), sendOut);
-        createTcpHeader(&tcpPkt->tcpv4.tcp_hdr, flow, TCP_FIN_FLAG, sendOut);
+    F::patchIpHeader(&udpPkt.ip_hdr, sizeof(UDP_HEADER) + dataLen, flow.ipId[sendOut]++);
+    udpPkt.udp_hdr.udp_len = htons_u(dataLen + sizeof(UDP_HEADER));
+    if ( flow.checksums ) fillUdpChecksums<F>(flow, udpPkt, payload.constData(), dataLen);
 
-        tcpPkt->tcpv4.tcp_hdr.seq_num = sendOut ? htonl_u(flow->txBytes) : htonl_u(flow->rxBytes);
-        tcpPkt->tcpv4.tcp_hdr.ack_num = sendOut ? htonl_u(flow->rxBytes) : htonl_u(flow->txBytes);
-    }
+    W::appendRecord(chain, flow, tsNs, &udpPkt, sizeof(udpPkt), payload, 0, dataLen, headersOnly);
+    return tsNs + FOLLOW_UP_GAP_NS;
+}
+
+template<typename F, typename W>
+static constexpr PKT_BUILDER PktBuilder = {
+    &buildTcpHandshakePktT<F, W>,
+    &buildTcpResumePktT<F, W>,
+    &buildTcpFinPktT<F, W>,
+    &buildTcpPayloadPktT<F, W>,
+    &buildUdpPayloadPktT<F, W>,
+};
 
-    sendOut ? flow->txBytes++ : flow->rxBytes++;
+
+static qint64 buildTcpHandshakePkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, const qint64 tsNs) {
+    return flow->builder->tcpHandshake(chain, *flow, tsNs);
 }
 
+static qint64 buildTcpResumePkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, const qint64 tsNs) {
+    return flow->builder->tcpResume(chain, *flow, tsNs);
+}
 
-static void createTcpDataPkt(const QSharedPointer<FLOW_TRACK> &flow, TCP_PKT *tcpPkt, const unsigned int payloadLen, const bool sendOut) {
+// ReSharper disable once CppDFAConstantParameter
+static qint64 buildTcpFinPkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, const qint64 tsNs, const bool sendOut) {
+    return flow->builder->tcpFin(chain, *flow, tsNs, sendOut);
+}
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+static qint64 buildTcpPayloadPkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, const qint64 tsNs, const QByteArray &payload, const bool sendOut,
+                               const bool headersOnly) {
+    return flow->builder->tcpPayload(chain, *flow, tsNs, payload, sendOut, headersOnly);
+}
 
-    if (isIpv6) {
-        createEthernetHeader(&tcpPkt->tcpv6.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv6.ip_hdr), flow, sizeof(TCP_HEADER) + payloadLen, sendOut);
-        createTcpHeader(&tcpPkt->tcpv6.tcp_hdr, flow, TCP_PSH_FLAG | TCP_ACK_FLAG, sendOut);
+static qint64 buildUdpPayloadPkt(RecordChain &chain, const PoolPtr<FLOW_TRACK> &flow, const qint64 tsNs, const QByteArray &payload, const bool sendOut,
+                               const bool headersOnly) {
+    return flow->builder->udpPayload(chain, *flow, tsNs, payload, sendOut, headersOnly);
+}
+
+// 不写出的数据不生成记录, 只推进 seq, Wireshark 中显示为未抓到的分段
+static void dropTcpPayload(const PoolPtr<FLOW_TRACK> &flow, const qint64 bytes, const bool sendOut) {
+    uint64_t &seq = sendOut ? flow->txBytes : flow->rxBytes;
+    seq += static_cast<uint64_t>(bytes);
+}
+
+// 超出预算的数据另外计入截断字节数
+static void skipTcpPayload(const PoolPtr<FLOW_TRACK> &flow, const qint64 skipped, const bool sendOut) {
+    dropTcpPayload(flow, skipped, sendOut);
+    flow->truncated[sendOut] += skipped;
+}
+
+
+// 两个方向的地址与端口只是互换, 部分和相同, 取任一方向的模板即可
+// 模板中长度, 标识, seq/ack, 标志位与校验和均为 0
+template<typename F, typename P, typename H>
+static void initChecksumSeeds(FLOW_TRACK &flow, const P &pkt, const H &l4Hdr) {
+
+    flow.ipCsumSeed = Checksum::partial(&pkt.ip_hdr, sizeof(pkt.ip_hdr));
+    flow.l4CsumSeed = F::pseudoSeed(&pkt.ip_hdr) + htons_u(flow.protocol) + Checksum::partial(&l4Hdr, sizeof(l4Hdr));
+}
+
+// 连接建立时为两个方向各构建一份报文头模板, 并按地址族与输出格式选定构建函数
+// mss 为 0 时按地址族取默认值; 精简模式下模板中的以太网头留空, 写出时跳过
+static void initHeaderTemplates(const PoolPtr<FLOW_TRACK> &flow, const CAPTURE_FORMAT format, const unsigned short mss, const bool checksums,
+                                const bool lean) {
 
-        tcpPkt->tcpv6.tcp_hdr.seq_num = sendOut ? htonl_u(flow->txBytes) : htonl_u(flow->rxBytes);
-        tcpPkt->tcpv6.tcp_hdr.ack_num = sendOut ? htonl_u(flow->rxBytes) : htonl_u(flow->txBytes);
+    const bool isIpv6 = flow->src.isIpv6();
+
+    flow->isIpv6 = isIpv6;
+    flow->lean = lean;
+    flow->mss = mss ? mss : (isIpv6 ? TCP_MSS_IPV6_DEFAULT : TCP_MSS_IPV4_DEFAULT);
+    if ( format == CAPTURE_FORMAT_PCAPNG ) {
+        flow->builder = isIpv6 ? &PktBuilder<IPV6_FAMILY, PCAPNG_WRITER> : &PktBuilder<IPV4_FAMILY, PCAPNG_WRITER>;
+        flow->comment = flow->domain;
+        flow->commentPending = !flow->domain.isEmpty();
     } else {
-        createEthernetHeader(&tcpPkt->tcpv4.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&tcpPkt->tcpv4.ip_hdr), flow, sizeof(TCP_HEADER) + payloadLen, sendOut);
-        createTcpHeader(&tcpPkt->tcpv4.tcp_hdr, flow, TCP_PSH_FLAG | TCP_ACK_FLAG, sendOut);
+        flow->builder = isIpv6 ? &PktBuilder<IPV6_FAMILY, PCAP_WRITER> : &PktBuilder<IPV4_FAMILY, PCAP_WRITER>;
+    }
 
-        tcpPkt->tcpv4.tcp_hdr.seq_num = sendOut ? htonl_u(flow->txBytes) : htonl_u(flow->rxBytes);
-        tcpPkt->tcpv4.tcp_hdr.ack_num = sendOut ? htonl_u(flow->rxBytes) : htonl_u(flow->txBytes);
+    for ( const bool sendOut : {false, true} ) {
+        auto &tmpl = flow->hdrTmpl[sendOut];
+        memset(&tmpl, 0, sizeof(tmpl));
+
+        if ( flow->protocol == PROTOCOL_TCP ) {
+            if (isIpv6) {
+                if ( !lean ) createEthernetHeader(&tmpl.tcp.tcpv6.eth_hdr, sendOut, isIpv6);
+                createIpHeader(reinterpret_cast<IP_HEADER *>(&tmpl.tcp.tcpv6.ip_hdr), flow, sendOut);
+                createTcpHeader(&tmpl.tcp.tcpv6.tcp_hdr, flow, sendOut);
+            } else {
+                if ( !lean ) createEthernetHeader(&tmpl.tcp.tcpv4.eth_hdr, sendOut, isIpv6);
+                createIpHeader(reinterpret_cast<IP_HEADER *>(&tmpl.tcp.tcpv4.ip_hdr), flow, sendOut);
+                createTcpHeader(&tmpl.tcp.tcpv4.tcp_hdr, flow, sendOut);
+            }
+        } else {
+            if (isIpv6) {
+                if ( !lean ) createEthernetHeader(&tmpl.udp.udpv6.eth_hdr, sendOut, isIpv6);
+                createIpHeader(reinterpret_cast<IP_HEADER *>(&tmpl.udp.udpv6.ip_hdr), flow, sendOut);
+                createUdpHeader(&tmpl.udp.udpv6.udp_hdr, flow, sendOut);
+            } else {
+                if ( !lean ) createEthernetHeader(&tmpl.udp.udpv4.eth_hdr, sendOut, isIpv6);
+                createIpHeader(reinterpret_cast<IP_HEADER *>(&tmpl.udp.udpv4.ip_hdr), flow, sendOut);
+                createUdpHeader(&tmpl.udp.udpv4.udp_hdr, flow, sendOut);
+            }
+        }
     }
 
-    if ( sendOut ) flow->txBytes += payloadLen;
-    else flow->rxBytes += payloadLen;
+    flow->checksums = checksums;
+    if ( !checksums ) return;
+
+    const auto &tmpl = flow->hdrTmpl[0];
+    if ( flow->protocol == PROTOCOL_TCP ) {
+        if (isIpv6) initChecksumSeeds<IPV6_FAMILY>(*flow, tmpl.tcp.tcpv6, tmpl.tcp.tcpv6.tcp_hdr);
+        else initChecksumSeeds<IPV4_FAMILY>(*flow, tmpl.tcp.tcpv4, tmpl.tcp.tcpv4.tcp_hdr);
+    } else {
+        if (isIpv6) initChecksumSeeds<IPV6_FAMILY>(*flow, tmpl.udp.udpv6, tmpl.udp.udpv6.udp_hdr);
+        else initChecksumSeeds<IPV4_FAMILY>(*flow, tmpl.udp.udpv4, tmpl.udp.udpv4.udp_hdr);
+    }
 }
 
-static void createUdpDataPkt(const QSharedPointer<FLOW_TRACK> &flow, UDP_PKT *udpPkt, const unsigned int payloadLen, const bool sendOut) {
 
-    const bool isIpv6 = flow->srcIp.protocol() == QAbstractSocket::IPv6Protocol;
+static void createEthernetHeader(ETHERNET_HEADER *ethernet, const bool sendOut, const bool isIpv6) {
+
+    static unsigned char fake_src_mac[MAC_ADDRESS_LEN] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60};
+    static unsigned char fake_dst_mac[MAC_ADDRESS_LEN] = {0xf0, 0xe0, 0xd0, 0xc0, 0xb0, 0xa0};
+
+    if ( sendOut ) {
+        memcpy(ethernet->src_mac, fake_src_mac, MAC_ADDRESS_LEN);
+        memcpy(ethernet->dst_mac, fake_dst_mac, MAC_ADDRESS_LEN);
+    } else {
+        memcpy(ethernet->src_mac, fake_dst_mac, MAC_ADDRESS_LEN);
+        memcpy(ethernet->dst_mac, fake_src_mac, MAC_ADDRESS_LEN);
+    }
 
     if (isIpv6) {
-        createEthernetHeader(&udpPkt->udpv6.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&udpPkt->udpv6.ip_hdr), flow, sizeof(UDP_HEADER) + payloadLen, sendOut);
-        createUdpHeader(&udpPkt->udpv6.udp_hdr, flow, payloadLen, sendOut);
+        ethernet->type = htons_u(ETHERNET_FRAME_IPv6);
     } else {
-        createEthernetHeader(&udpPkt->udpv4.eth_hdr, sendOut, isIpv6);
-        createIpHeader(reinterpret_cast<IP_HEADER *>(&udpPkt->udpv4.ip_hdr), flow, sizeof(UDP_HEADER) + payloadLen, sendOut);
-        createUdpHeader(&udpPkt->udpv4.udp_hdr, flow, payloadLen, sendOut);
+        ethernet->type = htons_u(ETHERNET_FRAME_IP);
     }
 }
 
-static bool writePktsOut(const QString &filePath, const QByteArray &fileContent) {
+// 长度与标识字段由每包路径填写
+static void createIpHeader(IP_HEADER *ipHdr, const PoolPtr<FLOW_TRACK> &flow, const bool sendOut) {
 
-    auto bs = fileContent;
+    if (flow->isIpv6) {
+        ipHdr->ipv6.ver_tc_flow     = htonl_u((6 << 28) | (0 << 20) | 0); // version=6, traffic class=0, flow label=0
+        ipHdr->ipv6.payload_length  = 0;                                 // 不包括IPv6头部，单位为字节
+        ipHdr->ipv6.next_header     = flow->protocol;                    // 通常是 TCP(6) 或 UDP(17)
+        ipHdr->ipv6.hop_limit       = 90;                               // 类似TTL
 
-    if ( !QFile(filePath).exists() ) {
-        PCAP_HDR capHdr = {};
-        capHdr.magic_number     = 0xa1b2c3d4;
-        capHdr.version_major    = 0x02;
-        capHdr.version_minor    = 0x04;
-        capHdr.thiszone         = 0;
-        capHdr.sigfigs          = 0;
-        capHdr.snaplen          = 0xA0000000;
-        capHdr.network          = 0x01;
-        bs.insert(0, reinterpret_cast<const char *>(&capHdr), sizeof(capHdr));
-    }
+        memcpy(ipHdr->ipv6.src_ip, sendOut ? flow->src.ip : flow->dst.ip, sizeof(ipHdr->ipv6.src_ip));
+        memcpy(ipHdr->ipv6.dst_ip, sendOut ? flow->dst.ip : flow->src.ip, sizeof(ipHdr->ipv6.dst_ip));
+    } else {
+        ipHdr->ipv4.hdr_len    = 5;
+        ipHdr->ipv4.ver        = 4;
+        ipHdr->ipv4.tos        = 0;
+        ipHdr->ipv4.flags      = 0x0000;
+        ipHdr->ipv4.ttl        = 90;
+        ipHdr->ipv4.protocol   = flow->protocol;
+        ipHdr->ipv4.id         = 0;
 
-    bool result = false;
-    QFile file(filePath);
-    if ( file.open(QIODevice::Append) ) {
-        file.write(bs);
-        result = true;
+        // FLOW_ADDR 已是网络字节序
+        memcpy(&ipHdr->ipv4.src_ip, sendOut ? flow->src.ip : flow->dst.ip, sizeof(ipHdr->ipv4.src_ip));
+        memcpy(&ipHdr->ipv4.dst_ip, sendOut ? flow->dst.ip : flow->src.ip, sizeof(ipHdr->ipv4.dst_ip));
+
+        ipHdr->ipv4.total_len = 0;
+        ipHdr->ipv4.checksum = 0;
     }
-    return result;
+}
+
+static void createTcpHeader(TCP_HEADER *tcpHdr, const PoolPtr<FLOW_TRACK> &flow, const bool sendOut) {
+
+    tcpHdr->src_port = sendOut ? flow->src.port : flow->dst.port;
+    tcpHdr->dst_port = sendOut ? flow->dst.port : flow->src.port;
+
+    tcpHdr->seq_num = 0;
+    tcpHdr->ack_num = 0;
+
+    tcpHdr->unused = 0;
+    tcpHdr->hdr_len = 5; // 5个双字 标准20字节头
+
+    tcpHdr->flags = 0;
+    tcpHdr->wnd_size = htons_u(0x8000u);
+
+    tcpHdr->checksum = 0;
+    tcpHdr->urg_pointer = 0;
+}
+
+static void createUdpHeader(UDP_HEADER *udpHdr, const PoolPtr<FLOW_TRACK> &flow, const bool sendOut) {
+
+    udpHdr->src_port = sendOut ? flow->src.port : flow->dst.port;
+    udpHdr->dst_port = sendOut ? flow->dst.port : flow->src.port;
+
+    udpHdr->udp_len = 0;
+    udpHdr->checksum = 0;
 }
@@ -23,15 +23,42 @@
 #ifndef PRISM_UI_DUMP_H
 #define PRISM_UI_DUMP_H
 
-#include <QSharedPointer>
-#include "custom/safe_map.hpp"
+#include <QSet>
+#include <QHash>
+#include <QQueue>
+#include <atomic>
+#include <thread>
+#include "custom/flat_map.hpp"
+#include "custom/object_pool.hpp"
+#include "custom/spsc_ring.hpp"
+#include "capture_file.h"
+#include "capture_index.h"
+#include "filter.h"
+#include "flow_registry.h"
+#include "stream_dump.h"
 #include "ui_mainwgt.h"
 
 
 // 多久刷新一下到磁盘
 #define FILE_FLUSH_INTERVAL_MS      (10 * 1000)
+// 打开输出文件失败后的重试间隔, 每次失败翻倍直到上限
+#define FILE_OPEN_RETRY_MIN_MS      1000
+#define FILE_OPEN_RETRY_MAX_MS      (60 * 1000)
 // 最大缓存字节数
 #define CACHING_BUFFER_MAX_BYTES    (1 * 1024 * 1024)
+// 写盘失败时待写记录的默认内存上限
+#define CACHING_LIMIT_DEFAULT_MB    64
+// 丢弃最旧记录时释放到上限的 3/4, 只保留报文头的策略从 3/4 开始降级
+#define CACHING_LOW_WATER(limit)    ((limit) / 4 * 3)
+// 写线程模式下事件队列容量
+#define DUMP_RING_CAPACITY          (16 * 1024)
+// 写线程空闲时的休眠间隔
+#define DUMP_WRITER_IDLE_MS         1
+// 明文切分为 TCP 报文段的默认 MSS, 对应 1500 字节的 MTU
+#define TCP_MSS_IPV4_DEFAULT        1460
+#define TCP_MSS_IPV6_DEFAULT        1440
+// 每多少个数据段合成一个对方的 ACK
+#define TCP_ACK_EVERY_SEGMENTS      2
 
 
 
@@ -68,6 +95,9 @@
 (((x) & 0xff000000) >> 24u) )
 #define htonl_u(x)              ntohl_u(x)
 
+// 累计字节数转为报文中的 seq/ack, 按 2^32 回绕
+#define TCP_SEQ(bytes)          htonl_u(static_cast<uint32_t>(bytes))
+
 
 
 // 保存对齐状态
@@ -179,6 +209,70 @@ union UDP_PKT {
     UDP_PKT_V6          udpv6;
 };
 
+// 每个流每个方向预构建的报文头
+union FLOW_HDR_TMPL {
+    TCP_PKT             tcp;
+    UDP_PKT             udp;
+};
+
+
+// pcapng file format
+#define PCAPNG_BT_SHB           0x0A0D0D0Au         // Section Header Block
+#define PCAPNG_BT_IDB           0x00000001u         // Interface Description Block
+#define PCAPNG_BT_NRB           0x00000004u         // Name Resolution Block
+#define PCAPNG_BT_EPB           0x00000006u         // Enhanced Packet Block
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4Du
+
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_IF_TSRESOL   9
+
+#define PCAPNG_NRB_END          0
+#define PCAPNG_NRB_IPV4         1
+#define PCAPNG_NRB_IPV6         2
+
+// 块与选项都按 4 字节对齐
+#define PCAPNG_PAD4(x)          (((x) + 3u) & ~3u)
+
+typedef struct PCAPNG_OPTION_ {
+    uint16_t            code;
+    uint16_t            length;             // 不含填充
+} PCAPNG_OPTION;
+
+typedef struct PCAPNG_SHB_ {
+    uint32_t            block_type;         // PCAPNG_BT_SHB
+    uint32_t            block_total_length;
+    uint32_t            byte_order_magic;   // PCAPNG_BYTE_ORDER_MAGIC
+    uint16_t            version_major;      // 1
+    uint16_t            version_minor;      // 0
+    int64_t             section_length;     // -1 未知
+    uint32_t            block_total_length_tail;
+} PCAPNG_SHB;
+
+typedef struct PCAPNG_IDB_ {
+    uint32_t            block_type;         // PCAPNG_BT_IDB
+    uint32_t            block_total_length;
+    uint16_t            link_type;          // 见 CAPTURE_LINKTYPE
+    uint16_t            reserved;
+    uint32_t            snaplen;
+    PCAPNG_OPTION       tsresol_opt;        // if_tsresol
+    uint8_t             tsresol;            // 9: 纳秒
+    uint8_t             tsresol_pad[3];
+    PCAPNG_OPTION       end_opt;
+    uint32_t            block_total_length_tail;
+} PCAPNG_IDB;
+
+// Enhanced Packet Block 固定部分, 之后依次为报文数据, 填充, 选项, 尾部长度
+typedef struct PCAPNG_EPB_ {
+    uint32_t            block_type;         // PCAPNG_BT_EPB
+    uint32_t            block_total_length;
+    uint32_t            interface_id;
+    uint32_t            ts_high;
+    uint32_t            ts_low;
+    uint32_t            captured_len;
+    uint32_t            orig_len;
+} PCAPNG_EPB;
+
 
 // 恢复对齐状态
 #pragma pack(pop)
@@ -193,7 +287,7 @@ typedef struct PCAP_HDR_ {
     int thiszone;                       // GMT to local correction    // 0
     unsigned int sigfigs;               // accuracy of timestamps     // 0
     unsigned int snaplen;               // max length of captured packets, in octets      // 0x40000
-    unsigned int network;               // data link type             // LINKTYPE_ETHERNET 1
+    unsigned int network;               // data link type             // 见 CAPTURE_LINKTYPE
 }PCAP_HDR;
 
 // packet header
@@ -210,47 +304,128 @@ typedef struct PCAPREC_HDR_ {
 
 
 
-// IN HOST BYTE ORDER
-typedef struct FLOW_TRACK_ {
+struct PKT_BUILDER_;
+
+// 地址与端口为网络字节序, 见 FLOW_ADDR
+typedef struct FLOW_TRACK_ : PoolCounted {
     FLOW_TRACK_(
-        const QHostAddress& srcIp,
-        const QHostAddress& dstIp,
-        const unsigned short srcPort,
-        const unsigned short dstPort,
+        const FLOW_ADDR& src,
+        const FLOW_ADDR& dst,
         const int protocol,
-        const unsigned int rxBytes,
-        const unsigned int txBytes)
-        : srcIp(srcIp),
-          dstIp(dstIp),
-          srcPort(srcPort),
-          dstPort(dstPort),
+        const uint64_t rxBytes,
+        const uint64_t txBytes)
+        : src(src),
+          dst(dst),
           protocol(protocol),
           rxBytes(rxBytes),
           txBytes(txBytes) {
 
-        if (srcIp.protocol() != dstIp.protocol()) {
-            if (srcIp.protocol() == QAbstractSocket::IPv6Protocol) {
-                const QString ipv6Mapped = QStringLiteral("::ffff:") + dstIp.toString();
-                this->dstIp = QHostAddress(ipv6Mapped);
-            } else {
-                const QString ipv6Mapped = QStringLiteral("::ffff:") + srcIp.toString();
-                this->srcIp = QHostAddress(ipv6Mapped);
-            }
+        // 两端地址族不同时把 IPv4 一端映射为 IPv6
+        if (this->src.family != this->dst.family) {
+            this->src.mapToIpv6();
+            this->dst.mapToIpv6();
         }
     }
 
     FLOW_TRACK_() = default;
 
-    QHostAddress srcIp;
-    QHostAddress dstIp;
-    unsigned short srcPort = 0;
-    unsigned short dstPort = 0;
+    FLOW_ADDR src{};
+    FLOW_ADDR dst{};
     int protocol = 0;
-    unsigned int rxBytes = 0;
-    unsigned int txBytes = 0;
+    // 两个方向累计的字节数, 报文中的 seq/ack 取低 32 位, 见 TCP_SEQ
+    uint64_t rxBytes = 0;
+    uint64_t txBytes = 0;
+
+    // 连接建立时构建, 下标为 sendOut
+    bool isIpv6 = false;
+    FLOW_HDR_TMPL hdrTmpl[2] = {};
+    unsigned short ipId[2] = {0x00a0, 0x0010};
+    const PKT_BUILDER_ *builder = nullptr;
+    // TCP 明文切分的段长
+    unsigned short mss = TCP_MSS_IPV4_DEFAULT;
+    // 精简模式: 不写以太网头, 不合成数据段的 ACK
+    bool lean = false;
+    unsigned int linkSkip() const { return this->lean ? sizeof(ETHERNET_HEADER) : 0; }
+    // 校验和模式下模板的部分和, 两个方向相同
+    bool checksums = false;
+    uint64_t ipCsumSeed = 0;
+    uint64_t l4CsumSeed = 0;
+
+    // SOCKS 目标域名, 目标为 IP 时为空
+    QByteArray domain{};
+    // pcapng 下流的第一个报文携带 opt_comment
+    QByteArray comment{};
+    bool commentPending = false;
+    // 超出抓包预算未写入的字节数, 下标为 sendOut
+    qint64 truncated[2] = {};
+    // 记录链中标识该流, 见 FLOW_KEY
+    qint64 key = 0;
+    // 生成索引时登记每条记录, 只在写线程访问
+    CaptureIndex *index = nullptr;
+    // 缓存超过内存上限时丢弃的记录数与明文字节数
+    unsigned int drops = 0;
+    qint64 dropBytes = 0;
+    // 合并中的同方向小块明文与第一块的时间戳, 只在写线程访问
+    QByteArray coalesced{};
+    bool coalescedSendOut = false;
+    qint64 coalescedTsNs = 0;
 }FLOW_TRACK;
 
 
+// 待写记录超过内存上限时的处理策略
+enum DUMP_DROP_POLICY {
+    DUMP_DROP_NEWEST    = 0,    // 丢弃新到的记录
+    DUMP_DROP_OLDEST    = 1,    // 从缓存头部丢弃整条记录
+    DUMP_DROP_METADATA  = 2,    // 先降级为只保留报文头, 到上限后丢弃新记录
+};
+
+
+// 中继线程投递给写线程的事件
+enum DUMP_EVENT_TYPE {
+    DUMP_STREAM_MADE,
+    DUMP_STREAM_DATA,
+    DUMP_STREAM_TEARDOWN,
+    DUMP_DGRAM_MADE,
+    DUMP_DGRAM_DATA,
+    DUMP_DGRAM_TEARDOWN,
+};
+
+typedef struct DUMP_EVENT_ {
+    DUMP_EVENT_TYPE             type = DUMP_STREAM_DATA;
+    int                         index = 0;          // flow id
+    bool                        sendOut = false;    // 方向
+    qint64                      timestamp = 0;      // 纳秒 UTC, 见 CaptureClock
+    QByteArray                  payload{};          // 明文数据副本
+    qint64                      skipped = 0;        // 超出抓包预算而未拷贝的字节数
+    qint64                      dropped = 0;        // 之前队列满时丢弃的字节数, 排在 payload 之前
+    PoolPtr<FLOW_TRACK>         flow{};             // 仅 MADE 事件携带
+} DUMP_EVENT;
+
+// 写线程统计
+struct DUMP_STATS {
+    bool                threaded;
+    unsigned int        queueDepth;             // 含队列满时积压在中继线程的事件
+    unsigned int        queueCapacity;
+    unsigned long long  queueDrops;
+    unsigned long long  writeLatencyUs;         // 最近一次写盘耗时
+    unsigned long long  writeLatencyMaxUs;      // 最大写盘耗时
+    unsigned int        filesOpened;            // 本次抓包打开过的文件数
+    unsigned long long  codecRawBytes;          // 压缩前字节数
+    unsigned long long  codecBytes;             // 压缩后字节数
+    unsigned long long  codecCpuUs;             // 压缩耗费的 CPU 时间
+    unsigned int        openStreams;            // 原始流模式下打开着的流
+    unsigned long long  truncatedBytes;         // 超出流抓包预算未写入的字节数
+    unsigned long long  filteredFlows;          // 被抓包过滤器排除的流
+    unsigned long long  cachingLimit;           // 待写记录的内存上限, 0 表示不限
+    DUMP_DROP_POLICY    dropPolicy;
+    unsigned long long  drops;                  // 超出内存上限丢弃或降级的记录数
+    unsigned long long  dropBytes;              // 其中未写出的字节数
+    unsigned int        dropFlows;              // 发生过丢弃的流数
+    unsigned long long  coalescedChunks;        // 并入前一块而没有单独成段的明文块数
+    unsigned long long  ioErrors;               // 写盘失败次数, io_uring 失败后截掉的字节计入 dropBytes
+};
+
+
 
 class PacketDumper {
 
@@ -266,49 +441,163 @@ public:
         return *instance;
     }
 
-    void onStreamConnectionMade(
-        const char *domainLocal,
-        const char *addrLocal,
-        unsigned short portLocal,
-        const char *domainRemote,
-        const char *addrRemote,
-        unsigned short portRemote,
-        int streamIndex
-        );
-    void onStreamTeardown(int streamIndex);
-    void onPlainStream(const char *data, size_t dataLen, bool sendOut, int streamIndex);
-
-    void onDgramConnectionMade(
-        const char *domainLocal,
-        const char *addrLocal,
-        unsigned short portLocal,
-        const char *domainRemote,
-        const char *addrRemote,
-        unsigned short portRemote,
-        int dgramIndex
-        );
-    void onDgramTeardown(int dgramIndex);
-    void onPlainDgram(const char *data, size_t dataLen, bool sendOut, int dgramIndex);
-
-    unsigned int getCachingBytes() const { return m_cachingBytesLen; }
+    // 中继线程调用, flow 来自 FlowRegistry, 闸门保存在其中
+    void onStreamConnectionMade(FLOW_RECORD &flow);
+    void onStreamTeardown(const FLOW_RECORD &flow);
+    void onPlainStream(FLOW_RECORD &flow, const char *data, size_t dataLen, bool sendOut);
+
+    void onDgramConnectionMade(FLOW_RECORD &flow);
+    void onDgramTeardown(const FLOW_RECORD &flow);
+    void onPlainDgram(FLOW_RECORD &flow, const char *data, size_t dataLen, bool sendOut);
+
+    // 开始/结束一次抓包, threaded 为 true 时记录构建与写盘都放到独立写线程
+    void start(bool threaded);
+    void stop();
+
+    unsigned long long getCachingBytes() const { return m_cachingBytesLen; }
+    DUMP_STATS getDumpStats() const;
     void setPcapFilePath(const QString &filePath) { this->m_pcapFilePath = filePath; }
+    void setCaptureFormat(const CAPTURE_FORMAT format) { this->m_format = format; }
+    void setCaptureCodec(const CAPTURE_CODEC codec) { this->m_codec = codec; }
+    void setCaptureIo(const CAPTURE_IO io, const bool syncEachFlush) { this->m_file.setIo(io, syncEachFlush); }
+    // TCP 明文切分的段长, 0 表示按地址族取默认值, 新建的流生效
+    void setTcpMss(const unsigned short mss) { this->m_tcpMss = mss; }
+    // 每个流每个方向最多写入的明文字节数, 0 表示不限, 新建的流生效
+    void setFlowBudget(const qint64 txBytes, const qint64 rxBytes) {
+        this->m_budget[true] = txBytes;
+        this->m_budget[false] = rxBytes;
+    }
+    // 抓包过滤表达式, 空串表示全部抓取, 新建的流生效; 编译失败时返回 false 并保留原过滤器
+    bool setCaptureFilter(const QString &expression, QString *error = nullptr) {
+        return this->m_filter.compile(expression, error);
+    }
+    // 写盘失败时待写记录的内存上限与超限后的处理策略, 0 表示不限
+    void setCachingLimit(const qint64 maxBytes, const DUMP_DROP_POLICY policy) {
+        this->m_cachingLimit = maxBytes;
+        this->m_dropPolicy = policy;
+    }
+    // TCP 同方向小块明文在 windowUs 微秒内合并到 maxBytes 后再切分, 0 字节表示按 MSS, 0 微秒表示不合并
+    // 下次抓包生效
+    void setCoalescing(const qint64 windowUs, const qint64 maxBytes) {
+        this->m_coalesceNs = windowUs * 1000;
+        this->m_coalesceBytes = maxBytes;
+    }
+    // 精简模式: 链路层类型为 LINKTYPE_RAW, 不合成数据段的 ACK, 下次抓包生效
+    void setLeanCapture(const bool enable) { this->m_lean = enable; }
+    // 在抓包文件旁写出 .idx 索引, 压缩与原始流模式下不生成, 下次抓包生效
+    void setCaptureIndex(const bool enable) { this->m_indexWanted = enable; }
+    // 为合成的报文填写正确的 IP/TCP/UDP 校验和, 新建的流生效
+    void setChecksums(const bool enable) { this->m_checksums = enable; }
+    // 单个文件超过 maxBytes 字节或 maxSeconds 秒后切换新文件, 0 表示不限
+    // maxFiles 为保留的文件数, 0 表示全部保留
+    void setRotation(const qint64 maxBytes, const qint64 maxSeconds, const unsigned int maxFiles) {
+        this->m_rotateBytes = maxBytes;
+        this->m_rotateSeconds = maxSeconds;
+        this->m_rotateFiles = maxFiles;
+    }
 
 private:
     PacketDumper() { this->m_lastRefreshTimer.start(); }
     ~PacketDumper() = default;
 
+    bool postEvent(DUMP_EVENT &&event);
+    bool drainOverflow();
+    void processEvent(const DUMP_EVENT &event);
+    void writerRoutine();
+
+    void appendNameResolution(const PoolPtr<FLOW_TRACK> &flow);
+
+    void processStreamEvent(const DUMP_EVENT &event, bool isStream);
+
+    bool admitFlow(FLOW_RECORD &flow);
+    static qsizetype consumeBudget(FLOW_GATE &gate, bool isStream, bool sendOut, qsizetype len);
+
+    enum CACHING_ADMIT { CACHING_ADMIT_FULL, CACHING_ADMIT_HEADERS, CACHING_ADMIT_NONE };
+    CACHING_ADMIT admitCaching();
+    void countDrop(FLOW_TRACK &flow, unsigned int records, qint64 bytes);
+
+    void appendStreamPayload(const PoolPtr<FLOW_TRACK> &flow, qint64 timestamp, const QByteArray &payload, bool sendOut,
+                             CACHING_ADMIT admit);
+    void coalescePayload(const PoolPtr<FLOW_TRACK> &flow, const DUMP_EVENT &event);
+    void flushCoalesced(const PoolPtr<FLOW_TRACK> &flow);
+    void expireCoalesced(qint64 nowNs);
+
+    bool rotationEnabled() const { return this->m_rotateBytes > 0 || this->m_rotateSeconds > 0; }
+    void rotateIfNeeded(qint64 timestamp);
+    bool openCaptureFile();
+    void describeLiveFlows(qint64 tsNs);
+    bool countFileLoss(qint64 fileOffset);
+
     void savePkts(bool flush);
     bool timerExpired();
 
-    ThreadSafeMap<QString, QSharedPointer<FLOW_TRACK>> m_flows{};
+    // 键见 FLOW_KEY, 只在写线程访问
+    FlatHashMap<PoolPtr<FLOW_TRACK>> m_flows{};
 
     // 保存到的文件路径
     QString m_pcapFilePath{};
-    // 还没有保存到本地的字节
-    QByteArray m_cachingBytes{};
-    unsigned int m_cachingBytesLen{0};
+    // 抓包期间保持打开的输出文件
+    CaptureFile m_file{};
+    // 抓包文件旁的索引
+    CaptureIndex m_index{};
+    bool m_indexWanted{true};
+    CAPTURE_FORMAT m_format{CAPTURE_FORMAT_PCAP};
+    CAPTURE_CODEC m_codec{CAPTURE_CODEC_NONE};
+    unsigned short m_tcpMss{0};
+    // 流抓包预算, 下标为 sendOut
+    qint64 m_budget[2] = {};
+    CaptureFilter m_filter{};
+    std::atomic<unsigned long long> m_filteredFlows{0};
+    std::atomic<unsigned long long> m_truncatedBytes{0};
+    bool m_checksums{false};
+    bool m_lean{false};
+    // 小块明文合并, 见 setCoalescing
+    qint64 m_coalesceNs{0};
+    qint64 m_coalesceBytes{0};
+    // 有待合并明文的流与其开始合并的时间, 按先后排列, 只在写线程访问
+    QQueue<QPair<PoolPtr<FLOW_TRACK>, qint64>> m_coalescing{};
+    std::atomic<unsigned long long> m_coalescedChunks{0};
+    // 原始流模式的输出
+    StreamDumper m_streams{};
+    // 已写入 NRB 的 地址/域名 组合
+    QSet<QByteArray> m_resolvedNames{};
+
+    // 文件轮转
+    qint64 m_rotateBytes{0};
+    qint64 m_rotateSeconds{0};
+    unsigned int m_rotateFiles{0};
+    QElapsedTimer m_fileTimer{};
+    QList<QString> m_ringFiles{};
+    std::atomic<unsigned int> m_filesOpened{0};
+    // 打开失败后等待 m_openRetryMs 再试, 为 0 表示可以立即打开
+    QElapsedTimer m_openRetryTimer{};
+    qint64 m_openRetryMs{0};
+    // 还没有保存到本地的记录
+    RecordChain m_cachingChain{};
+    std::atomic<unsigned long long> m_cachingBytesLen{0};
+    // 待写记录的内存上限与超限策略
+    qint64 m_cachingLimit{static_cast<qint64>(CACHING_LIMIT_DEFAULT_MB) * 1024 * 1024};
+    DUMP_DROP_POLICY m_dropPolicy{DUMP_DROP_NEWEST};
+    // 下一条记录可用的最早时间戳, 只在写线程访问
+    qint64 m_nextTsNs{0};
+    std::atomic<unsigned long long> m_drops{0};
+    std::atomic<unsigned long long> m_dropBytes{0};
+    std::atomic<unsigned int> m_dropFlows{0};
 
     QElapsedTimer m_lastRefreshTimer{};
+
+    // 写线程
+    bool m_threaded{false};
+    std::thread m_writer{};
+    std::atomic<bool> m_stopping{false};
+    SpscRing<DUMP_EVENT> m_ring{DUMP_RING_CAPACITY};
+    // 队列满时积压的控制事件, 只在中继线程访问
+    QList<DUMP_EVENT> m_overflow{};
+    std::atomic<unsigned int> m_overflowDepth{0};
+
+    std::atomic<unsigned long long> m_queueDrops{0};
+    std::atomic<unsigned long long> m_writeLatencyUs{0};
+    std::atomic<unsigned long long> m_writeLatencyMaxUs{0};
 };
 
 #endif //PRISM_UI_DUMP_H
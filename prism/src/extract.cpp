@@ -0,0 +1,402 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTextStream>
+#include <cstring>
+#include <limits>
+#include "capture_index.h"
+
+
+// 按 .idx 索引从抓包文件中提取部分流写入新的抓包文件
+// 只读取索引, 文件头与选中的记录区间, 不解析其它记录
+// 时间条件按区间筛选, 与时间范围有交集的区间整体保留
+// 流 id 每次打开抓包文件 (每个 section) 重新编号, 追加写入的文件中同一 id 可能属于不同的流, 可用 段号/tcp:N 限定
+
+// 映射失败时按块读取
+#define EXTRACT_COPY_CHUNK      (4 * 1024 * 1024)
+
+
+// 抓包文件中的一个 section 与其中选中的区间
+typedef struct EXTRACT_SECTION_ {
+    qint64                          offset = 0;
+    QSet<qint64>                    flows{};            // 选中的流
+    QList<QPair<qint64, qint64>>    ranges{};           // 偏移, 长度
+} EXTRACT_SECTION;
+
+typedef struct EXTRACT_QUERY_ {
+    QSet<qint64>                    keys{};             // 任意 section 中的流
+    QSet<QPair<qint64, qint64>>     sectionKeys{};      // section 序号, 流
+    QList<QRegularExpression>       domains{};
+    qint64                          from = std::numeric_limits<qint64>::min();
+    qint64                          to = std::numeric_limits<qint64>::max();
+    bool                            list = false;
+} EXTRACT_QUERY;
+
+
+static QTextStream &err() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// tcp:42, udp:7, 或只有流 id 时按 TCP; 前缀 段号/ 时只匹配该 section, 否则 *section 为 -1
+static bool parseFlow(QString text, qint64 *section, qint64 *key) {
+
+    *section = -1;
+    const qsizetype slash = text.indexOf(QChar('/'));
+    if ( slash >= 0 ) {
+        bool ok = false;
+        *section = text.left(slash).toLongLong(&ok);
+        if ( !ok || *section < 0 ) return false;
+        text = text.mid(slash + 1);
+    }
+
+    bool isStream = true;
+    QString index = text;
+    const qsizetype colon = text.indexOf(QChar(':'));
+    if ( colon >= 0 ) {
+        const QString proto = text.left(colon).toLower();
+        if ( proto == QStringLiteral("udp") ) {
+            isStream = false;
+        } else if ( proto != QStringLiteral("tcp") ) {
+            return false;
+        }
+        index = text.mid(colon + 1);
+    }
+
+    bool ok = false;
+    const int value = index.toInt(&ok);
+    if ( !ok || value < 0 ) return false;
+    *key = FLOW_KEY(isStream, value);
+    return true;
+}
+
+// ISO 8601 时间或纳秒 UTC
+static bool parseTime(const QString &text, qint64 *tsNs) {
+
+    bool ok = false;
+    const qint64 value = text.toLongLong(&ok);
+    if ( ok ) {
+        *tsNs = value;
+        return true;
+    }
+
+    const QDateTime time = QDateTime::fromString(text, Qt::ISODateWithMs);
+    if ( !time.isValid() ) return false;
+    *tsNs = time.toMSecsSinceEpoch() * 1000000;
+    return true;
+}
+
+static QString formatAddress(const CAPTURE_INDEX_FLOW_BODY &flow, const uint8_t *ip, const uint16_t port) {
+
+    if ( flow.family == 4 ) {
+        return QStringLiteral("%1.%2.%3.%4:%5").arg(ip[0]).arg(ip[1]).arg(ip[2]).arg(ip[3]).arg(port);
+    }
+
+    QStringList groups;
+    for ( int i = 0; i < 16; i += 2 ) {
+        groups.append(QString::number(ip[i] << 8 | ip[i + 1], 16));
+    }
+    return QStringLiteral("[%1]:%2").arg(groups.join(QChar(':'))).arg(port);
+}
+
+static bool matchesFlow(const EXTRACT_QUERY &query, const qint64 section, const CAPTURE_INDEX_FLOW_BODY &flow,
+                        const QString &domain) {
+
+    const auto key = static_cast<qint64>(flow.key);
+    if ( query.keys.isEmpty() && query.sectionKeys.isEmpty() && query.domains.isEmpty() ) return true;
+    if ( query.keys.contains(key) || query.sectionKeys.contains(qMakePair(section, key)) ) return true;
+    for ( const auto &pattern : query.domains ) {
+        if ( !domain.isEmpty() && pattern.match(domain).hasMatch() ) return true;
+    }
+    return false;
+}
+
+// 逐条读取索引, 按条件收集每个 section 中选中的区间, 相邻区间合并
+static bool scanIndex(const uchar *data, const qint64 size, const EXTRACT_QUERY &query,
+                      CAPTURE_FORMAT *format, QList<EXTRACT_SECTION> &sections) {
+
+    if ( size < static_cast<qint64>(sizeof(CAPTURE_INDEX_HDR)) ) return false;
+
+    CAPTURE_INDEX_HDR hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    if ( memcmp(hdr.magic, CAPTURE_INDEX_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != CAPTURE_INDEX_VERSION ) {
+        return false;
+    }
+    *format = static_cast<CAPTURE_FORMAT>(hdr.format);
+
+    qint64 pos = sizeof(hdr);
+    while ( pos + static_cast<qint64>(sizeof(CAPTURE_INDEX_ENTRY)) <= size ) {
+        CAPTURE_INDEX_ENTRY entry;
+        memcpy(&entry, data + pos, sizeof(entry));
+        pos += sizeof(entry);
+        // 写到一半的条目
+        if ( pos + entry.length > size ) break;
+        const uchar *body = data + pos;
+        pos += entry.length;
+
+        if ( entry.type == CAPTURE_INDEX_SECTION && entry.length >= sizeof(CAPTURE_INDEX_SECTION_BODY) ) {
+            CAPTURE_INDEX_SECTION_BODY section;
+            memcpy(&section, body, sizeof(section));
+            EXTRACT_SECTION extract;
+            extract.offset = static_cast<qint64>(section.offset);
+            sections.append(extract);
+            continue;
+        }
+        if ( sections.isEmpty() ) continue;
+        EXTRACT_SECTION &current = sections.last();
+
+        if ( entry.type == CAPTURE_INDEX_FLOW && entry.length >= sizeof(CAPTURE_INDEX_FLOW_BODY) ) {
+            CAPTURE_INDEX_FLOW_BODY flow;
+            memcpy(&flow, body, sizeof(flow));
+            const qsizetype domainLen = qMin<qsizetype>(flow.domain_len, entry.length - sizeof(flow));
+            const QString domain = QString::fromUtf8(reinterpret_cast<const char *>(body + sizeof(flow)), domainLen);
+
+            // 列出的 段号/协议:id 可以直接作为 --flow 的参数
+            if ( query.list ) {
+                QTextStream(stdout) << QStringLiteral("%1/%2:%3\t%4 -> %5\t%6\n").arg(
+                    QString::number(sections.size() - 1),
+                    flow.key >> 32 ? QStringLiteral("tcp") : QStringLiteral("udp"),
+                    QString::number(flow.key & 0xffffffffu),
+                    formatAddress(flow, flow.src_ip, flow.src_port),
+                    formatAddress(flow, flow.dst_ip, flow.dst_port),
+                    domain);
+            } else if ( matchesFlow(query, sections.size() - 1, flow, domain) ) {
+                current.flows.insert(static_cast<qint64>(flow.key));
+            }
+            continue;
+        }
+
+        if ( entry.type == CAPTURE_INDEX_RANGE && entry.length >= sizeof(CAPTURE_INDEX_RANGE_BODY) ) {
+            CAPTURE_INDEX_RANGE_BODY range;
+            memcpy(&range, body, sizeof(range));
+            if ( !current.flows.contains(static_cast<qint64>(range.key)) ) continue;
+            // 没有时间戳的区间 (域名解析块) 跟随所属的流
+            if ( range.first_ts && (range.last_ts < query.from || range.first_ts > query.to) ) continue;
+
+            const qint64 offset = static_cast<qint64>(range.offset);
+            const qint64 length = static_cast<qint64>(range.length);
+            if ( !current.ranges.isEmpty() && current.ranges.last().first + current.ranges.last().second == offset ) {
+                current.ranges.last().second += length;
+            } else {
+                current.ranges.append(qMakePair(offset, length));
+            }
+        }
+    }
+    return true;
+}
+
+static bool copyRange(QFile &capture, QFile &out, const qint64 offset, const qint64 length) {
+
+    uchar *mapped = capture.map(offset, length);
+    if ( mapped ) {
+        const bool result = out.write(reinterpret_cast<const char *>(mapped), length) == length;
+        capture.unmap(mapped);
+        return result;
+    }
+
+    if ( !capture.seek(offset) ) return false;
+    qint64 left = length;
+    while ( left > 0 ) {
+        const QByteArray chunk = capture.read(qMin<qint64>(left, EXTRACT_COPY_CHUNK));
+        if ( chunk.isEmpty() || out.write(chunk) != chunk.size() ) return false;
+        left -= chunk.size();
+    }
+    return true;
+}
+
+// pcap 只有文件开头的全局头; pcapng 每个 section 复制 SHB 与紧随其后的 IDB
+static qint64 sectionHeaderLength(QFile &capture, const CAPTURE_FORMAT format, const qint64 offset) {
+
+    if ( format != CAPTURE_FORMAT_PCAPNG ) return 24;
+
+    qint64 length = 0;
+    for ( int block = 0; block < 2; block++ ) {
+        uint32_t head[2] = {};
+        if ( !capture.seek(offset + length) ||
+             capture.read(reinterpret_cast<char *>(head), sizeof(head)) != sizeof(head) ||
+             head[1] < sizeof(head) ) {
+            return -1;
+        }
+        length += head[1];
+    }
+    return length;
+}
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("PRISMEXTRACT"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Extract flows from a PRISM capture using its .idx index"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("capture"), QStringLiteral("Capture file written by PRISMUI"));
+
+    const QCommandLineOption indexOption(QStringList{QStringLiteral("i"), QStringLiteral("index")},
+        QStringLiteral("Index file, defaults to <capture>.idx"), QStringLiteral("file"));
+    const QCommandLineOption outOption(QStringList{QStringLiteral("o"), QStringLiteral("output")},
+        QStringLiteral("Output capture file"), QStringLiteral("file"));
+    const QCommandLineOption flowOption(QStringList{QStringLiteral("f"), QStringLiteral("flow")},
+        QStringLiteral("Flow id as tcp:N, udp:N or N, repeatable. Ids restart in every section of an appended "
+                       "capture; prefix the section number as S/tcp:N to pick one, see --list"), QStringLiteral("flow"));
+    const QCommandLineOption domainOption(QStringList{QStringLiteral("d"), QStringLiteral("domain")},
+        QStringLiteral("Domain glob with * and ?, repeatable"), QStringLiteral("glob"));
+    const QCommandLineOption fromOption(QStringLiteral("from"),
+        QStringLiteral("Start time, ISO 8601 or nanoseconds UTC"), QStringLiteral("time"));
+    const QCommandLineOption toOption(QStringLiteral("to"),
+        QStringLiteral("End time, ISO 8601 or nanoseconds UTC"), QStringLiteral("time"));
+    const QCommandLineOption listOption(QStringList{QStringLiteral("l"), QStringLiteral("list")},
+        QStringLiteral("List indexed flows as S/tcp:N instead of extracting"));
+    parser.addOption(indexOption);
+    parser.addOption(outOption);
+    parser.addOption(flowOption);
+    parser.addOption(domainOption);
+    parser.addOption(fromOption);
+    parser.addOption(toOption);
+    parser.addOption(listOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if ( args.size() != 1 ) {
+        parser.showHelp(1);
+    }
+    const QString capturePath = args.first();
+    const QString indexPath = parser.isSet(indexOption) ? parser.value(indexOption) : CaptureIndex::indexPath(capturePath);
+
+    EXTRACT_QUERY query;
+    query.list = parser.isSet(listOption);
+    for ( const auto &text : parser.values(flowOption) ) {
+        qint64 section = -1, key = 0;
+        if ( !parseFlow(text, &section, &key) ) {
+            err() << "invalid flow: " << text << Qt::endl;
+            return 1;
+        }
+        if ( section >= 0 ) {
+            query.sectionKeys.insert(qMakePair(section, key));
+        } else {
+            query.keys.insert(key);
+        }
+    }
+    for ( const auto &glob : parser.values(domainOption) ) {
+        // 整个域名匹配, 不区分大小写
+        query.domains.append(QRegularExpression(QRegularExpression::wildcardToRegularExpression(glob),
+                                                QRegularExpression::CaseInsensitiveOption));
+    }
+    if ( (parser.isSet(fromOption) && !parseTime(parser.value(fromOption), &query.from)) ||
+         (parser.isSet(toOption) && !parseTime(parser.value(toOption), &query.to)) ) {
+        err() << "invalid time" << Qt::endl;
+        return 1;
+    }
+    if ( !query.list && !parser.isSet(outOption) ) {
+        err() << "missing --output" << Qt::endl;
+        return 1;
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    QFile index(indexPath);
+    if ( !index.open(QIODevice::ReadOnly) ) {
+        err() << "cannot open index " << indexPath << ": " << index.errorString() << Qt::endl;
+        return 1;
+    }
+    const qint64 indexSize = index.size();
+    const uchar *indexData = indexSize > 0 ? index.map(0, indexSize) : nullptr;
+    QByteArray indexCopy;
+    if ( indexSize > 0 && !indexData ) {
+        indexCopy = index.readAll();
+        indexData = reinterpret_cast<const uchar *>(indexCopy.constData());
+    }
+
+    CAPTURE_FORMAT format = CAPTURE_FORMAT_PCAP;
+    QList<EXTRACT_SECTION> sections;
+    if ( !indexData || !scanIndex(indexData, indexSize, query, &format, sections) ) {
+        err() << "not a capture index: " << indexPath << Qt::endl;
+        return 1;
+    }
+    if ( query.list ) {
+        return 0;
+    }
+
+    // 不带段号的流 id 在多个 section 中出现时提示, 仍全部提取
+    for ( const qint64 key : query.keys ) {
+        qsizetype found = 0;
+        for ( const auto &section : sections ) {
+            if ( section.flows.contains(key) ) found++;
+        }
+        if ( found > 1 ) {
+            err() << (key >> 32 ? "tcp:" : "udp:") << (key & 0xffffffff) << " appears in " << found
+                  << " sections, use S/" << (key >> 32 ? "tcp:" : "udp:") << (key & 0xffffffff)
+                  << " to pick one" << Qt::endl;
+        }
+    }
+
+    QFile capture(capturePath);
+    if ( !capture.open(QIODevice::ReadOnly) ) {
+        err() << "cannot open capture " << capturePath << ": " << capture.errorString() << Qt::endl;
+        return 1;
+    }
+    QFile out(parser.value(outOption));
+    if ( !out.open(QIODevice::WriteOnly | QIODevice::Truncate) ) {
+        err() << "cannot create " << out.fileName() << ": " << out.errorString() << Qt::endl;
+        return 1;
+    }
+
+    qint64 ranges = 0;
+    qint64 bytes = 0;
+    bool headerWritten = false;
+    for ( const auto &section : sections ) {
+        if ( section.ranges.isEmpty() ) continue;
+
+        // pcap 全局头只写一次, pcapng 每个 section 带自己的 SHB 与 IDB
+        if ( format == CAPTURE_FORMAT_PCAPNG || !headerWritten ) {
+            const qint64 headerOffset = format == CAPTURE_FORMAT_PCAPNG ? section.offset : 0;
+            const qint64 headerLen = sectionHeaderLength(capture, format, headerOffset);
+            if ( headerLen < 0 || !copyRange(capture, out, headerOffset, headerLen) ) {
+                err() << "cannot read capture header at " << headerOffset << Qt::endl;
+                return 1;
+            }
+            headerWritten = true;
+        }
+
+        for ( const auto &range : section.ranges ) {
+            if ( !copyRange(capture, out, range.first, range.second) ) {
+                err() << "cannot copy " << range.second << " bytes at " << range.first << Qt::endl;
+                return 1;
+            }
+            ranges++;
+            bytes += range.second;
+        }
+    }
+
+    err() << ranges << " ranges, " << bytes << " bytes in " << elapsed.elapsed() << " ms" << Qt::endl;
+    return ranges ? 0 : 2;
+}
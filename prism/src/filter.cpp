@@ -0,0 +1,300 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "filter.h"
+#include <QStringList>
+
+
+// 不区分大小写的通配符匹配, * 匹配任意串, ? 匹配单个字符
+static bool globMatch(const QByteArray &pattern, const QByteArray &text) {
+
+    const auto lower = [](const char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    };
+
+    qsizetype p = 0, t = 0;
+    qsizetype starP = -1, starT = 0;
+    while ( t < text.size() ) {
+        if ( p < pattern.size() && (pattern[p] == '?' || pattern[p] == lower(text[t])) ) {
+            p++;
+            t++;
+        } else if ( p < pattern.size() && pattern[p] == '*' ) {
+            starP = p++;
+            starT = t;
+        } else if ( starP >= 0 ) {
+            // 回到上一个 * 多吞一个字符
+            p = starP + 1;
+            t = ++starT;
+        } else {
+            return false;
+        }
+    }
+    while ( p < pattern.size() && pattern[p] == '*' ) p++;
+    return p == pattern.size();
+}
+
+
+// 递归下降解析, 边解析边输出后缀程序
+class FilterParser {
+
+public:
+    FilterParser(const QStringList &tokens,
+                 QList<FILTER_INSN> &program,
+                 QList<QByteArray> &globs,
+                 QList<QPair<QHostAddress, int>> &subnets)
+        : m_tokens(tokens), m_program(program), m_globs(globs), m_subnets(subnets) {}
+
+    bool parse() {
+        if ( !this->parseExpr() ) return false;
+        if ( this->m_pos < this->m_tokens.size() ) {
+            return this->fail(QStringLiteral("Unexpected '%1'").arg(this->m_tokens[this->m_pos]));
+        }
+        return true;
+    }
+
+    QString error() const { return this->m_error; }
+
+private:
+    bool atEnd() const { return this->m_pos >= this->m_tokens.size(); }
+
+    bool accept(const char *a, const char *b = nullptr) {
+        if ( this->atEnd() ) return false;
+        const QString &token = this->m_tokens[this->m_pos];
+        if ( token == QLatin1String(a) || (b && token == QLatin1String(b)) ) {
+            this->m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool fail(const QString &message) {
+        this->m_error = message;
+        return false;
+    }
+
+    void push(const FILTER_OPCODE op, const int arg = 0, const unsigned short lo = 0, const unsigned short hi = 0) {
+        this->m_program.append({op, arg, lo, hi});
+    }
+
+    bool parseExpr() {
+        if ( !this->parseTerm() ) return false;
+        while ( this->accept("or", "||") ) {
+            if ( !this->parseTerm() ) return false;
+            this->push(FILTER_OP_OR);
+        }
+        return true;
+    }
+
+    bool parseTerm() {
+        if ( !this->parseFactor() ) return false;
+        while ( this->accept("and", "&&") ) {
+            if ( !this->parseFactor() ) return false;
+            this->push(FILTER_OP_AND);
+        }
+        return true;
+    }
+
+    // 每层 not 与括号递归一次, 超过上限立即失败, 不等到输出程序后再检查
+    bool parseFactor() {
+        if ( this->accept("not", "!") ) {
+            if ( ++this->m_nesting > FILTER_MAX_DEPTH ) return this->fail(QStringLiteral("Filter is nested too deeply"));
+            if ( !this->parseFactor() ) return false;
+            this->m_nesting--;
+            this->push(FILTER_OP_NOT);
+            return true;
+        }
+        if ( this->accept("(") ) {
+            if ( ++this->m_nesting > FILTER_MAX_DEPTH ) return this->fail(QStringLiteral("Filter is nested too deeply"));
+            if ( !this->parseExpr() ) return false;
+            if ( !this->accept(")") ) return this->fail(QStringLiteral("Missing ')'"));
+            this->m_nesting--;
+            return true;
+        }
+        return this->parsePrimary();
+    }
+
+    bool parsePrimary() {
+        if ( this->atEnd() ) return this->fail(QStringLiteral("Unexpected end of filter"));
+
+        const QString keyword = this->m_tokens[this->m_pos++];
+        if ( keyword == QLatin1String("tcp") )  { this->push(FILTER_OP_TCP);  return true; }
+        if ( keyword == QLatin1String("udp") )  { this->push(FILTER_OP_UDP);  return true; }
+        if ( keyword == QLatin1String("ipv4") ) { this->push(FILTER_OP_IPV4); return true; }
+        if ( keyword == QLatin1String("ipv6") ) { this->push(FILTER_OP_IPV6); return true; }
+
+        const bool isHost = keyword == QLatin1String("host");
+        const bool isDomain = keyword == QLatin1String("domain");
+        const bool isPort = keyword == QLatin1String("port");
+        const bool isNet = keyword == QLatin1String("net");
+        const bool isClient = keyword == QLatin1String("client");
+        if ( !isHost && !isDomain && !isPort && !isNet && !isClient ) {
+            return this->fail(QStringLiteral("Unknown keyword '%1'").arg(keyword));
+        }
+
+        if ( this->atEnd() || this->m_tokens[this->m_pos] == QLatin1String("(") ||
+             this->m_tokens[this->m_pos] == QLatin1String(")") ) {
+            return this->fail(QStringLiteral("'%1' needs a value").arg(keyword));
+        }
+        const QString value = this->m_tokens[this->m_pos++];
+
+        if ( isHost || isDomain ) {
+            this->push(isHost ? FILTER_OP_HOST : FILTER_OP_DOMAIN, static_cast<int>(this->m_globs.size()));
+            this->m_globs.append(value.toLower().toUtf8());
+            return true;
+        }
+
+        if ( isPort ) {
+            const QStringList range = value.split(QLatin1Char('-'));
+            bool ok1 = false, ok2 = false;
+            const int lo = range.value(0).toInt(&ok1);
+            const int hi = range.size() > 1 ? range.value(1).toInt(&ok2) : lo;
+            if ( range.size() > 2 || !ok1 || (range.size() > 1 && !ok2) || lo < 0 || hi > 65535 || lo > hi ) {
+                return this->fail(QStringLiteral("Invalid port '%1'").arg(value));
+            }
+            this->push(FILTER_OP_PORT, 0, static_cast<unsigned short>(lo), static_cast<unsigned short>(hi));
+            return true;
+        }
+
+        // 不带前缀长度时按单个地址处理
+        QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(value);
+        if ( subnet.first.isNull() ) {
+            const QHostAddress address(value);
+            if ( address.isNull() ) {
+                return this->fail(QStringLiteral("Invalid address '%1'").arg(value));
+            }
+            subnet = QPair<QHostAddress, int>(address, address.protocol() == QAbstractSocket::IPv6Protocol ? 128 : 32);
+        }
+        this->push(isNet ? FILTER_OP_NET : FILTER_OP_CLIENT, static_cast<int>(this->m_subnets.size()));
+        this->m_subnets.append(subnet);
+        return true;
+    }
+
+    const QStringList &m_tokens;
+    QList<FILTER_INSN> &m_program;
+    QList<QByteArray> &m_globs;
+    QList<QPair<QHostAddress, int>> &m_subnets;
+    qsizetype m_pos{0};
+    int m_nesting{0};
+    QString m_error{};
+};
+
+
+static QStringList tokenize(const QString &expression) {
+
+    QStringList tokens;
+    QString current;
+    for ( qsizetype i = 0; i < expression.size(); i++ ) {
+        const QChar c = expression.at(i);
+        // 括号与 ! 单独成词, 其余以空白分隔
+        if ( c.isSpace() || c == QLatin1Char('(') || c == QLatin1Char(')') || c == QLatin1Char('!') ) {
+            if ( !current.isEmpty() ) {
+                tokens.append(current);
+                current.clear();
+            }
+            if ( !c.isSpace() ) tokens.append(QString(c));
+        } else {
+            current.append(c);
+        }
+    }
+    if ( !current.isEmpty() ) tokens.append(current);
+    return tokens;
+}
+
+
+bool CaptureFilter::compile(const QString &expression, QString *error) {
+
+    QList<FILTER_INSN> program;
+    QList<QByteArray> globs;
+    QList<QPair<QHostAddress, int>> subnets;
+
+    const QStringList tokens = tokenize(expression.trimmed());
+    if ( !tokens.isEmpty() ) {
+        FilterParser parser(tokens, program, globs, subnets);
+        if ( !parser.parse() ) {
+            if ( error ) *error = parser.error();
+            return false;
+        }
+
+        int depth = 0, maxDepth = 0;
+        for ( const auto &insn : program ) {
+            if ( insn.op == FILTER_OP_AND || insn.op == FILTER_OP_OR ) depth--;
+            else if ( insn.op != FILTER_OP_NOT ) depth++;
+            maxDepth = qMax(maxDepth, depth);
+        }
+        if ( maxDepth > FILTER_MAX_DEPTH ) {
+            if ( error ) *error = QStringLiteral("Filter is nested too deeply");
+            return false;
+        }
+    }
+
+    this->m_program = program;
+    this->m_globs = globs;
+    this->m_subnets = subnets;
+    this->m_expression = expression.trimmed();
+    return true;
+}
+
+bool CaptureFilter::matches(const FILTER_INPUT &input) const {
+
+    if ( this->m_program.isEmpty() ) return true;
+
+    bool stack[FILTER_MAX_DEPTH];
+    int top = 0;
+
+    for ( const auto &insn : this->m_program ) {
+        switch ( insn.op ) {
+        case FILTER_OP_TCP:     stack[top++] = input.isTcp; break;
+        case FILTER_OP_UDP:     stack[top++] = !input.isTcp; break;
+        case FILTER_OP_IPV4:    stack[top++] = !input.isIpv6; break;
+        case FILTER_OP_IPV6:    stack[top++] = input.isIpv6; break;
+        case FILTER_OP_HOST:
+            stack[top++] = (!input.domain.isEmpty() && globMatch(this->m_globs[insn.arg], input.domain)) ||
+                           globMatch(this->m_globs[insn.arg], input.remoteAddr);
+            break;
+        case FILTER_OP_DOMAIN:
+            stack[top++] = !input.domain.isEmpty() && globMatch(this->m_globs[insn.arg], input.domain);
+            break;
+        case FILTER_OP_PORT:
+            stack[top++] = input.remotePort >= insn.lo && input.remotePort <= insn.hi;
+            break;
+        case FILTER_OP_NET:
+            stack[top++] = input.remote.isInSubnet(this->m_subnets[insn.arg].first, this->m_subnets[insn.arg].second);
+            break;
+        case FILTER_OP_CLIENT:
+            stack[top++] = input.client.isInSubnet(this->m_subnets[insn.arg].first, this->m_subnets[insn.arg].second);
+            break;
+        case FILTER_OP_NOT:
+            stack[top - 1] = !stack[top - 1];
+            break;
+        case FILTER_OP_AND:
+            top--;
+            stack[top - 1] = stack[top - 1] && stack[top];
+            break;
+        case FILTER_OP_OR:
+            top--;
+            stack[top - 1] = stack[top - 1] || stack[top];
+            break;
+        }
+    }
+
+    return top == 1 && stack[0];
+}
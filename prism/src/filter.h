@@ -0,0 +1,104 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_FILTER_H
+#define PRISM_FILTER_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+
+// 求值栈深度与 not/括号嵌套层数的上限, 超过的表达式编译失败
+#define FILTER_MAX_DEPTH            64
+
+
+// 过滤器的输入, 连接建立时构造一次
+typedef struct FILTER_INPUT_ {
+    bool                isTcp;
+    bool                isIpv6;
+    QByteArray          domain;         // SOCKS 目标域名, 目标为 IP 时为空
+    QByteArray          remoteAddr;     // 目标地址文本
+    QHostAddress        remote;
+    unsigned short      remotePort;
+    QHostAddress        client;
+} FILTER_INPUT;
+
+
+enum FILTER_OPCODE {
+    FILTER_OP_TCP,
+    FILTER_OP_UDP,
+    FILTER_OP_IPV4,
+    FILTER_OP_IPV6,
+    FILTER_OP_HOST,                 // 域名或目标地址匹配通配符
+    FILTER_OP_DOMAIN,               // 域名匹配通配符
+    FILTER_OP_PORT,                 // 目标端口在 [lo, hi] 内
+    FILTER_OP_NET,                  // 目标地址在子网内
+    FILTER_OP_CLIENT,               // 客户端地址在子网内
+    FILTER_OP_NOT,
+    FILTER_OP_AND,
+    FILTER_OP_OR,
+};
+
+typedef struct FILTER_INSN_ {
+    FILTER_OPCODE       op;
+    int                 arg;            // 通配符或子网的下标
+    unsigned short      lo;
+    unsigned short      hi;
+} FILTER_INSN;
+
+
+// 抓包过滤器
+// 表达式编译为一段后缀程序, 连接建立时对每个流求值一次, 数据路径上不再参与
+//
+//   expr    := term ( ("or" | "||") term )*
+//   term    := factor ( ("and" | "&&") factor )*
+//   factor  := ("not" | "!") factor | "(" expr ")" | primary
+//   primary := "tcp" | "udp" | "ipv4" | "ipv6"
+//            | "host" GLOB           域名或目标地址, 支持 * 与 ?, 不区分大小写
+//            | "domain" GLOB         仅域名
+//            | "port" N | "port" N-M 目标端口
+//            | "net" ADDR[/LEN]      目标地址所在子网
+//            | "client" ADDR[/LEN]   客户端地址所在子网
+//
+// 例: tcp and (domain *.example.com or port 8000-8999) and not client 10.0.0.0/8
+class CaptureFilter {
+
+public:
+    // 空表达式表示全部抓取; 编译失败时保留原程序, error 为错误描述
+    bool compile(const QString &expression, QString *error = nullptr);
+    bool isEmpty() const { return this->m_program.isEmpty(); }
+    QString expression() const { return this->m_expression; }
+
+    bool matches(const FILTER_INPUT &input) const;
+
+private:
+    QList<FILTER_INSN> m_program{};
+    QList<QByteArray> m_globs{};
+    QList<QPair<QHostAddress, int>> m_subnets{};
+    QString m_expression{};
+};
+
+
+#endif //PRISM_FILTER_H
@@ -22,99 +22,15 @@
  */
 
 #include "flow.h"
-#include "misc.h"
 
-void FlowDumper::onStreamConnectionMade(const char *domainLocal, const char *addrLocal, unsigned short portLocal,
-                                        const char *domainRemote, const char *addrRemote, unsigned short portRemote, int streamIndex) {
-
-    (void)addrLocal;
-    (void)addrRemote;
-
-    const auto key = MiscFuncs::genFlowKey(true, streamIndex);
-    Q_ASSERT(!this->m_flows.contains(key));
-
-    const auto node = QSharedPointer<FLOW_NODE>::create(
-        streamIndex,
-        domainLocal,
-        portLocal,
-        domainRemote,
-        portRemote,
-        true
-        );
-    this->m_flows.set(key, node);
-}
-
-// ReSharper disable once CppParameterMayBeConst
-void FlowDumper::onStreamTeardown(int streamIndex) {
-
-    const auto key = MiscFuncs::genFlowKey(true, streamIndex);
-    Q_ASSERT(this->m_flows.contains(key));
-    this->m_flows.remove(key);
-}
-
-// ReSharper disable once CppParameterMayBeConst
-void FlowDumper::onPlainStream(const char *data, size_t dataLen, bool sendOut, int streamIndex) {
-
-    (void)data;
-
-    const auto key = MiscFuncs::genFlowKey(true, streamIndex);
-    Q_ASSERT(this->m_flows.contains(key));
-
-    this->m_flows.update(key, [dataLen, sendOut](const QSharedPointer<FLOW_NODE> &node) {
-        if (sendOut) {
-            node->txBytes += dataLen;
-        } else {
-            node->rxBytes += dataLen;
-        }
-    });
-}
-
-void FlowDumper::onDgramConnectionMade(const char *domainLocal, const char *addrLocal, unsigned short portLocal,
-    const char *domainRemote, const char *addrRemote, unsigned short portRemote, int dgramIndex) {
-
-    (void)addrLocal;
-    (void)addrRemote;
-
-    const auto key = MiscFuncs::genFlowKey(false, dgramIndex);
-    Q_ASSERT(!this->m_flows.contains(key));
-
-    const auto node = QSharedPointer<FLOW_NODE>::create(
-        dgramIndex,
-        domainLocal,
-        portLocal,
-        domainRemote,
-        portRemote,
-        false
-        );
-    this->m_flows.set(key, node);
-}
-
-// ReSharper disable once CppParameterMayBeConst
-void FlowDumper::onDgramTeardown(int dgramIndex) {
-
-    const auto key = MiscFuncs::genFlowKey(false, dgramIndex);
-    Q_ASSERT(this->m_flows.contains(key));
-    this->m_flows.remove(key);
-}
-
-// ReSharper disable once CppParameterMayBeConst
-void FlowDumper::onPlainDgram(const char *data, size_t dataLen, bool sendOut, int dgramIndex) {
-
-    (void)data;
-
-    const auto key = MiscFuncs::genFlowKey(false, dgramIndex);
-    Q_ASSERT(this->m_flows.contains(key));
+QVector<QSharedPointer<FLOW_NODE>> FlowDumper::all() const {
 
-    this->m_flows.update(key, [dataLen, sendOut](const QSharedPointer<FLOW_NODE> &node) {
-        if (sendOut) {
-            node->txBytes += dataLen;
-        } else {
-            node->rxBytes += dataLen;
-        }
-    });
-}
+    const auto records = FlowRegistry::instance().snapshot();
 
-QVector<QSharedPointer<FLOW_NODE>> FlowDumper::all() const {
-    return this->m_flows.values();
+    QVector<QSharedPointer<FLOW_NODE>> nodes;
+    nodes.reserve(records.size());
+    for (const auto &record : records) {
+        nodes.append(QSharedPointer<FLOW_NODE>::create(*record));
+    }
+    return nodes;
 }
-
@@ -23,55 +23,36 @@
 #ifndef PRISM_UI_FLOW_H
 #define PRISM_UI_FLOW_H
 
-#include <QHostAddress>
+#include <QSharedPointer>
 #include <QTime>
-#include "custom/safe_map.hpp"
+#include "flow_registry.h"
 
+// 界面使用的流快照
 typedef struct FLOW_NODE_ {
-    explicit FLOW_NODE_(
-        const int index,
-        QString localAddr,
-        const unsigned short localPort,
-        QString remoteAddr,
-        const unsigned short remotePort,
-        const bool isStream)
-        : isStream(isStream),
-          index(index), localAddr(std::move(localAddr)),
-          localPort(localPort), remoteAddr(std::move(remoteAddr)),
-          remotePort(remotePort)
-    {
-        this->createTime = QTime::currentTime();
-        this->rxBytes = 0;
-        this->txBytes = 0;
-
-        const auto haLocal = QHostAddress(localAddr);
-        const auto haRemote = QHostAddress(remoteAddr);
-        if (haLocal.protocol() != haRemote.protocol()) {
-            if (haLocal.protocol() == QAbstractSocket::IPv6Protocol) {
-                const QString ipv6Mapped = QStringLiteral("::ffff:") + remoteAddr;
-                this->remoteAddr = QHostAddress(ipv6Mapped).toString();
-            } else {
-                const QString ipv6Mapped = QStringLiteral("::ffff:") + localAddr;
-                this->localAddr = QHostAddress(ipv6Mapped).toString();
-            }
-        }
-
-        this->isIpv6 = QHostAddress(localAddr).protocol() == QAbstractSocket::IPv6Protocol;
-    };
+    explicit FLOW_NODE_(const FLOW_RECORD &record)
+        : createTime(record.createTime),
+          isStream(record.isStream),
+          index(record.index),
+          local(record.local),
+          remote(record.remote),
+          domain(record.domain),
+          isIpv6(record.isIpv6),
+          rxBytes(record.rxBytes.load(std::memory_order_relaxed)),
+          txBytes(record.txBytes.load(std::memory_order_relaxed)) {}
 
     QTime createTime;
     bool isStream;
     int index;
 
-    QString localAddr;
-    unsigned short localPort;
-    QString remoteAddr;
-    unsigned short remotePort;
+    // 文本形式由界面按需生成
+    FLOW_ADDR local;
+    FLOW_ADDR remote;
+    QByteArray domain;
 
     bool isIpv6;
 
-    unsigned int rxBytes;
-    unsigned int txBytes;
+    unsigned long long rxBytes;
+    unsigned long long txBytes;
 } FLOW_NODE;
 
 
@@ -89,37 +70,12 @@ public:
         return *instance;
     }
 
-    void onStreamConnectionMade(
-    const char *domainLocal,
-    const char *addrLocal,
-    unsigned short portLocal,
-    const char *domainRemote,
-    const char *addrRemote,
-    unsigned short portRemote,
-    int streamIndex
-    );
-    void onStreamTeardown(int streamIndex);
-    void onPlainStream(const char *data, size_t dataLen, bool sendOut, int streamIndex);
-
-    void onDgramConnectionMade(
-        const char *domainLocal,
-        const char *addrLocal,
-        unsigned short portLocal,
-        const char *domainRemote,
-        const char *addrRemote,
-        unsigned short portRemote,
-        int dgramIndex
-        );
-    void onDgramTeardown(int dgramIndex);
-    void onPlainDgram(const char *data, size_t dataLen, bool sendOut, int dgramIndex);
-
+    // 从 FlowRegistry 取当前所有流的快照
     QVector<QSharedPointer<FLOW_NODE>> all() const;
 
 private:
     FlowDumper() = default;
     ~FlowDumper() = default;
-
-    ThreadSafeMap<QString, QSharedPointer<FLOW_NODE>> m_flows{};
 };
 
 
@@ -0,0 +1,77 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/23.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "flow_addr.h"
+#include <QtEndian>
+#include <cstring>
+
+
+FLOW_ADDR FLOW_ADDR::parse(const char *text, const unsigned short port) {
+
+    FLOW_ADDR addr = {};
+    addr.port = qToBigEndian<quint16>(port);
+
+    const QHostAddress host(QString::fromLatin1(text ? text : ""));
+    if ( host.protocol() == QAbstractSocket::IPv4Protocol ) {
+        qToBigEndian<quint32>(host.toIPv4Address(), addr.ip);
+        addr.family = FLOW_FAMILY_IPV4;
+    } else if ( host.protocol() == QAbstractSocket::IPv6Protocol ) {
+        const Q_IPV6ADDR ipv6 = host.toIPv6Address();
+        memcpy(addr.ip, ipv6.c, sizeof(addr.ip));
+        addr.family = FLOW_FAMILY_IPV6;
+    }
+    return addr;
+}
+
+unsigned short FLOW_ADDR::hostPort() const {
+
+    return qFromBigEndian<quint16>(this->port);
+}
+
+void FLOW_ADDR::mapToIpv6() {
+
+    if ( this->family != FLOW_FAMILY_IPV4 ) return;
+
+    uint8_t ipv4[4];
+    memcpy(ipv4, this->ip, sizeof(ipv4));
+    memset(this->ip, 0, 10);
+    this->ip[10] = 0xff;
+    this->ip[11] = 0xff;
+    memcpy(this->ip + 12, ipv4, sizeof(ipv4));
+    this->family = FLOW_FAMILY_IPV6;
+}
+
+QHostAddress FLOW_ADDR::toHostAddress() const {
+
+    if ( this->family == FLOW_FAMILY_IPV4 ) {
+        return QHostAddress(qFromBigEndian<quint32>(this->ip));
+    }
+    if ( this->family == FLOW_FAMILY_IPV6 ) {
+        return QHostAddress(this->ip);
+    }
+    return {};
+}
+
+QString FLOW_ADDR::toString() const {
+
+    return this->toHostAddress().toString();
+}
@@ -0,0 +1,56 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/23.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_FLOW_ADDR_H
+#define PRISM_FLOW_ADDR_H
+
+#include <QHostAddress>
+#include <cstdint>
+
+
+#define FLOW_FAMILY_NONE        0
+#define FLOW_FAMILY_IPV4        4
+#define FLOW_FAMILY_IPV6        6
+
+// 连接一端的二进制地址与端口, 连接建立时从文本解析一次
+// 地址与端口都是网络字节序, 可以直接拷进报文头; IPv4 只用 ip 的前 4 字节
+// 文本形式只在界面、hosts 等需要时再生成
+typedef struct FLOW_ADDR_ {
+    uint8_t     ip[16];
+    uint16_t    port;
+    uint8_t     family;
+
+    // port 为主机字节序, 无法解析的地址 family 为 FLOW_FAMILY_NONE
+    static FLOW_ADDR_ parse(const char *text, unsigned short port);
+
+    bool isIpv6() const { return this->family == FLOW_FAMILY_IPV6; }
+    unsigned short hostPort() const;
+    // IPv4 地址改写为 ::ffff:a.b.c.d
+    void mapToIpv6();
+
+    QHostAddress toHostAddress() const;
+    QString toString() const;
+} FLOW_ADDR;
+
+
+
+#endif //PRISM_FLOW_ADDR_H
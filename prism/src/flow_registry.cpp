@@ -0,0 +1,91 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/21.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "flow_registry.h"
+#include "capture_index.h"
+#include <cstring>
+
+
+FLOW_RECORD_::FLOW_RECORD_(
+    const bool isStream,
+    const int index,
+    const char *addrLocal,
+    const unsigned short portLocal,
+    const char *domainRemote,
+    const char *addrRemote,
+    const unsigned short portRemote)
+    : isStream(isStream),
+      index(index),
+      key(FLOW_KEY(isStream, index)),
+      local(FLOW_ADDR::parse(addrLocal, portLocal)),
+      remote(FLOW_ADDR::parse(addrRemote, portRemote)),
+      createTime(QTime::currentTime()) {
+
+    this->isIpv6 = this->local.isIpv6();
+    if ( domainRemote && (!addrRemote || strcmp(domainRemote, addrRemote) != 0) ) {
+        this->domain = QByteArray(domainRemote);
+    }
+}
+
+
+PoolPtr<FLOW_RECORD> FlowRegistry::open(const bool isStream, const int index, const char *addrLocal, const unsigned short portLocal,
+    const char *domainRemote, const char *addrRemote, const unsigned short portRemote) {
+
+    const auto record = PoolPtr<FLOW_RECORD>::create(
+        isStream,
+        index,
+        addrLocal,
+        portLocal,
+        domainRemote,
+        addrRemote,
+        portRemote
+        );
+
+    QMutexLocker locker(&this->m_mutex);
+    Q_ASSERT(!this->m_records.contains(record->key));
+    this->m_records.set(record->key, record);
+    return record;
+}
+
+// 只有本线程会修改表, 读取不需要加锁
+FLOW_RECORD *FlowRegistry::find(const bool isStream, const int index) const {
+
+    const auto *record = this->m_records.find(FLOW_KEY(isStream, index));
+    return record ? record->data() : nullptr;
+}
+
+PoolPtr<FLOW_RECORD> FlowRegistry::close(const bool isStream, const int index) {
+
+    QMutexLocker locker(&this->m_mutex);
+    return this->m_records.take(FLOW_KEY(isStream, index));
+}
+
+QVector<PoolPtr<FLOW_RECORD>> FlowRegistry::snapshot() const {
+
+    QMutexLocker locker(&this->m_mutex);
+    QVector<PoolPtr<FLOW_RECORD>> result;
+    result.reserve(static_cast<int>(this->m_records.size()));
+    this->m_records.forEach([&result](quint64, const PoolPtr<FLOW_RECORD> &record) {
+        result.append(record);
+    });
+    return result;
+}
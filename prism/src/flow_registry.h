@@ -0,0 +1,124 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/21.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_FLOW_REGISTRY_H
+#define PRISM_FLOW_REGISTRY_H
+
+#include <QMutex>
+#include <QTime>
+#include <QVector>
+#include <atomic>
+#include "custom/flat_map.hpp"
+#include "custom/object_pool.hpp"
+#include "flow_addr.h"
+
+
+// 中继线程内每个流的抓包闸门, 连接建立时求值一次
+typedef struct FLOW_GATE_ {
+    bool                capture = true;             // 过滤器是否选中该流
+    qint64              budgetLeft[2] = {-1, -1};   // 剩余预算, 下标为 sendOut, -1 表示不限
+    qint64              dropped[2] = {0, 0};        // 队列满时丢弃还没交给写线程的 TCP 字节数, 下标为 sendOut
+    qint64              skipped[2] = {0, 0};        // 预算用完后还没交给写线程的字节数, 下标为 sendOut
+} FLOW_GATE;
+
+// 一个连接的全部状态, 连接建立时创建一次, 同一个句柄交给抓包、流列表与 hosts
+typedef struct FLOW_RECORD_ : PoolCounted {
+    FLOW_RECORD_(
+        bool isStream,
+        int index,
+        const char *addrLocal,
+        unsigned short portLocal,
+        const char *domainRemote,
+        const char *addrRemote,
+        unsigned short portRemote);
+
+    // 标识, 建立后不变
+    bool isStream;
+    int index;
+    qint64 key;                     // 见 FLOW_KEY
+    FLOW_ADDR local;
+    FLOW_ADDR remote;
+    bool isIpv6;
+    QByteArray domain;              // SOCKS 目标域名, 目标为 IP 时为空
+
+    // 界面, 建立后不变
+    QTime createTime;
+
+    // 计数, 只有中继线程写, 界面线程读
+    std::atomic<unsigned long long> rxBytes{0};
+    std::atomic<unsigned long long> txBytes{0};
+
+    // 抓包状态, 只在中继线程访问
+    FLOW_GATE gate{};
+
+    // 唯一的写者不需要原子加
+    void account(const bool sendOut, const size_t len) {
+        auto &counter = sendOut ? this->txBytes : this->rxBytes;
+        counter.store(counter.load(std::memory_order_relaxed) + static_cast<unsigned long long>(len), std::memory_order_relaxed);
+    }
+} FLOW_RECORD;
+
+
+
+// 活动连接表
+// 只有中继线程增删, 中继线程查找不加锁; 其他线程通过 snapshot 加锁读取
+class FlowRegistry {
+
+public:
+    FlowRegistry(const FlowRegistry&) = delete;
+    FlowRegistry& operator=(const FlowRegistry&) = delete;
+
+    // Get the singleton instance
+    static FlowRegistry& instance() {
+        // Guaranteed thread-safe in C++11 and later
+        static auto *instance = new FlowRegistry;
+        return *instance;
+    }
+
+    // 以下在中继线程调用
+    PoolPtr<FLOW_RECORD> open(
+        bool isStream,
+        int index,
+        const char *addrLocal,
+        unsigned short portLocal,
+        const char *domainRemote,
+        const char *addrRemote,
+        unsigned short portRemote
+        );
+    FLOW_RECORD *find(bool isStream, int index) const;
+    PoolPtr<FLOW_RECORD> close(bool isStream, int index);
+
+    // 任意线程
+    QVector<PoolPtr<FLOW_RECORD>> snapshot() const;
+
+private:
+    FlowRegistry() = default;
+    ~FlowRegistry() = default;
+
+    mutable QMutex m_mutex{};
+    // 键见 FLOW_KEY
+    FlatHashMap<PoolPtr<FLOW_RECORD>> m_records{};
+};
+
+
+
+#endif //PRISM_FLOW_REGISTRY_H
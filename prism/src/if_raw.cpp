@@ -26,19 +26,45 @@ extern "C" {
 #include "socks5-crypto/socks5-crypto.h"
 }
 #include "custom/logging.hpp"
+#include "custom/sharded_counter.hpp"
 #include "if_raw.h"
 #include "dump.h"
 #include "hosts.h"
-#include "flow.h"
+#include "flow_registry.h"
 
 
 static bool Socks5CryptoServerStarted = false;
 
-static FLOW_STATS FlowStats;
+// FLOW_STATS 各字段对应的计数器
+enum FLOW_COUNTER {
+    TCP_FLOWS,
+    TCP_ACTIVE_FLOWS,
+    TCP_RX_BYTES,
+    TCP_TX_BYTES,
+    UDP_FLOWS,
+    UDP_ACTIVE_FLOWS,
+    UDP_RX_BYTES,
+    UDP_TX_BYTES,
+    FLOW_COUNTER_COUNT
+};
+
+static ShardedCounters<FLOW_COUNTER_COUNT> FlowCounters;
 
 static LOG_LEVEL CurrentLogLevel = LOG_KEY;
 
 
+// 目标以域名访问时记下 地址/域名 对应关系
+static void addHostsEntry(const FLOW_RECORD &flow) {
+
+    if ( flow.domain.isEmpty() ) return;
+
+    auto address = flow.remote.toHostAddress();
+    auto domain = QStringList(QString::fromUtf8(flow.domain));
+
+    HostsDumper::instance().addHostsNode(address, domain);
+}
+
+
 // ReSharper disable once CppParameterMayBeConst
 void on_bind(const char *host, unsigned short port) {
 
@@ -74,45 +100,33 @@ void on_stream_connection_made(
     }
 
 
-    FlowStats.tcpFlows++;
-    FlowStats.tcpActiveFlows++;
+    FlowCounters.add(TCP_FLOWS, 1);
+    FlowCounters.add(TCP_ACTIVE_FLOWS, 1);
 
-    PacketDumper::instance().onStreamConnectionMade(
-        domain_local,
-        addr_local,
-        port_local,
-        domain_remote,
-        addr_remote,
-        port_remote,
-        stream_index
-        );
-    FlowDumper::instance().onStreamConnectionMade(
-        domain_local,
+    // 每个连接只建一条记录, 各个消费者共用
+    const auto flow = FlowRegistry::instance().open(
+        true,
+        stream_index,
         addr_local,
         port_local,
         domain_remote,
         addr_remote,
-        port_remote,
-        stream_index
+        port_remote
         );
 
-    if (QString(addr_remote) != QString(domain_remote)) {
-
-        auto address = QHostAddress(QString(addr_remote));
-        auto domain = QStringList(domain_remote);
-
-        HostsDumper::instance().addHostsNode(address, domain);
-    }
+    PacketDumper::instance().onStreamConnectionMade(*flow);
+    addHostsEntry(*flow);
 }
 
 // ReSharper disable once CppParameterMayBeConst
 void on_stream_teardown(int stream_index) {
-    (void)stream_index;
 
-    FlowStats.tcpActiveFlows--;
+    FlowCounters.sub(TCP_ACTIVE_FLOWS, 1);
 
-    PacketDumper::instance().onStreamTeardown(stream_index);
-    FlowDumper::instance().onStreamTeardown(stream_index);
+    const auto flow = FlowRegistry::instance().close(true, stream_index);
+    if ( !flow ) return;
+
+    PacketDumper::instance().onStreamTeardown(*flow);
 }
 
 void on_plain_stream(
@@ -124,23 +138,18 @@ void on_plain_stream(
     // ReSharper disable once CppParameterMayBeConst
     int stream_index) {
 
-    if (send_out) {
-        FlowStats.tcpTxBytes += data_len;
-    } else {
-        FlowStats.tcpRxBytes += data_len;
-    }
+    FlowCounters.add(send_out ? TCP_TX_BYTES : TCP_RX_BYTES, data_len);
 
+    // 每块明文只查一次表
+    const auto flow = FlowRegistry::instance().find(true, stream_index);
+    if ( !flow ) return;
+
+    flow->account(send_out, data_len);
     PacketDumper::instance().onPlainStream(
+        *flow,
         data,
         data_len,
-        send_out,
-        stream_index
-        );
-    FlowDumper::instance().onPlainStream(
-        data,
-        data_len,
-        send_out,
-        stream_index
+        send_out
         );
 }
 
@@ -168,46 +177,32 @@ void on_dgram_connection_made(
     }
 
 
-    FlowStats.udpFlows++;
-    FlowStats.udpActiveFlows++;
+    FlowCounters.add(UDP_FLOWS, 1);
+    FlowCounters.add(UDP_ACTIVE_FLOWS, 1);
 
-    PacketDumper::instance().onDgramConnectionMade(
-        domain_local,
-        addr_local,
-        port_local,
-        domain_remote,
-        addr_remote,
-        port_remote,
-        dgram_index
-        );
-    FlowDumper::instance().onDgramConnectionMade(
-        domain_local,
+    const auto flow = FlowRegistry::instance().open(
+        false,
+        dgram_index,
         addr_local,
         port_local,
         domain_remote,
         addr_remote,
-        port_remote,
-        dgram_index
+        port_remote
         );
 
-
-    if (QString(addr_remote) != QString(domain_remote)) {
-
-        auto address = QHostAddress(QString(addr_remote));
-        auto domain = QStringList(domain_remote);
-
-        HostsDumper::instance().addHostsNode(address, domain);
-    }
+    PacketDumper::instance().onDgramConnectionMade(*flow);
+    addHostsEntry(*flow);
 }
 
 // ReSharper disable once CppParameterMayBeConst
 void on_dgram_teardown(int dgram_index) {
-    (void)dgram_index;
 
-    FlowStats.udpActiveFlows--;
+    FlowCounters.sub(UDP_ACTIVE_FLOWS, 1);
+
+    const auto flow = FlowRegistry::instance().close(false, dgram_index);
+    if ( !flow ) return;
 
-    PacketDumper::instance().onDgramTeardown(dgram_index);
-    FlowDumper::instance().onDgramTeardown(dgram_index);
+    PacketDumper::instance().onDgramTeardown(*flow);
 }
 
 
@@ -221,23 +216,17 @@ void on_plain_dgram(
     int dgram_index) {
 
 
-    if (send_out) {
-        FlowStats.udpTxBytes += data_len;
-    } else {
-        FlowStats.udpRxBytes += data_len;
-    }
+    FlowCounters.add(send_out ? UDP_TX_BYTES : UDP_RX_BYTES, data_len);
+
+    const auto flow = FlowRegistry::instance().find(false, dgram_index);
+    if ( !flow ) return;
 
+    flow->account(send_out, data_len);
     PacketDumper::instance().onPlainDgram(
+        *flow,
         data,
         data_len,
-        send_out,
-        dgram_index
-        );
-    FlowDumper::instance().onPlainDgram(
-        data,
-        data_len,
-        send_out,
-        dgram_index
+        send_out
         );
 }
 
@@ -317,7 +306,7 @@ void StartShadowsocksCryptoServer(
         return ;
     }
 
-    memset(&FlowStats, 0, sizeof(FlowStats));
+    FlowCounters.reset();
 
     globalSocks5Thread() = QtConcurrent::run(
         thread_routine,
@@ -356,7 +345,7 @@ void StartSocks5CryptoServer(
         return ;
     }
 
-    memset(&FlowStats, 0, sizeof(FlowStats));
+    FlowCounters.reset();
 
     globalSocks5Thread() = QtConcurrent::run(
         thread_routine,
@@ -386,7 +375,17 @@ void StopSocks5CryptoServer() {
 
 
 FLOW_STATS GetFlowStats() {
-    return FlowStats;
+
+    FLOW_STATS stats = {};
+    stats.tcpFlows          = FlowCounters.sum(TCP_FLOWS);
+    stats.tcpActiveFlows    = FlowCounters.sum(TCP_ACTIVE_FLOWS);
+    stats.tcpRxBytes        = FlowCounters.sum(TCP_RX_BYTES);
+    stats.tcpTxBytes        = FlowCounters.sum(TCP_TX_BYTES);
+    stats.udpFlows          = FlowCounters.sum(UDP_FLOWS);
+    stats.udpActiveFlows    = FlowCounters.sum(UDP_ACTIVE_FLOWS);
+    stats.udpRxBytes        = FlowCounters.sum(UDP_RX_BYTES);
+    stats.udpTxBytes        = FlowCounters.sum(UDP_TX_BYTES);
+    return stats;
 }
 
 LOG_LEVEL GetLogLevel() {
@@ -24,17 +24,17 @@
 #define PRISM_IF_RAW_H
 
 
-// 统计信息
+// 统计信息, 由 GetFlowStats 汇总各线程的分片
 struct FLOW_STATS {
-    unsigned int        tcpFlows;
-    unsigned int        tcpActiveFlows;
-    unsigned int        tcpRxBytes;
-    unsigned int        tcpTxBytes;
-
-    unsigned int        udpFlows;
-    unsigned int        udpActiveFlows;
-    unsigned int        udpRxBytes;
-    unsigned int        udpTxBytes;
+    unsigned long long  tcpFlows;
+    unsigned long long  tcpActiveFlows;
+    unsigned long long  tcpRxBytes;
+    unsigned long long  tcpTxBytes;
+
+    unsigned long long  udpFlows;
+    unsigned long long  udpActiveFlows;
+    unsigned long long  udpRxBytes;
+    unsigned long long  udpTxBytes;
 };
 
 
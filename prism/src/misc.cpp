@@ -21,10 +21,11 @@
  * IN THE SOFTWARE.
  */
 #include "misc.h"
+#include "capture_index.h"
 #include <QApplication>
 #include <QDir>
 
-QString MiscFuncs::formatBytes(const unsigned int bytes) {
+QString MiscFuncs::formatBytes(const unsigned long long bytes) {
 
     constexpr auto KB = 1024;
     constexpr auto MB = 1024 * 1024;
@@ -49,9 +50,9 @@ QString MiscFuncs::formatBytes(const unsigned int bytes) {
     return result;
 }
 
-QString MiscFuncs::genFlowKey(const bool isStream, const int index) {
+qint64 MiscFuncs::genFlowKey(const bool isStream, const int index) {
 
-    return QStringLiteral("%1[%2]").arg(isStream ? "TCP" : "UDP").arg(index);
+    return FLOW_KEY(isStream, index);
 }
 
 QString MiscFuncs::getExecutableRootPath() {
@@ -30,8 +30,8 @@
 class MiscFuncs {
 
 public:
-    static QString formatBytes(unsigned int bytes);
-    static QString genFlowKey(bool isStream, int index);
+    static QString formatBytes(unsigned long long bytes);
+    static qint64 genFlowKey(bool isStream, int index);
     static QString getExecutableRootPath();
 };
 
@@ -0,0 +1,220 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/14.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "record_chain.h"
+
+
+void RecordChain::appendHeader(const void *data, const qsizetype len) {
+
+    if ( len <= 0 ) return;
+
+    const qsizetype offset = this->m_arena.size();
+    this->m_arena.append(static_cast<const char *>(data), len);
+    this->m_bytes += len;
+
+    // 与上一段 arena 相邻时直接合并, 跟踪记录边界时不跨记录合并
+    const bool newRecord = this->m_tracking && !this->m_records.isEmpty() && this->m_records.last().segments == 0;
+    if ( !this->m_segments.isEmpty() && !newRecord ) {
+        auto &last = this->m_segments.last();
+        if ( last.payload.isNull() && last.offset + last.len == offset ) {
+            last.len += len;
+            if ( this->m_tracking ) this->m_records.last().bytes += len;
+            return;
+        }
+    }
+    this->m_segments.append({QByteArray(), offset, len});
+    if ( this->m_tracking ) this->trackSegment(len);
+}
+
+void RecordChain::appendPayload(const QByteArray &payload, const qsizetype offset, const qsizetype len) {
+
+    if ( len <= 0 ) return;
+
+    this->m_segments.append({payload, offset, len});
+    this->m_bytes += len;
+    if ( this->m_tracking ) this->trackSegment(len);
+}
+
+void RecordChain::reserve(const qsizetype headerBytes, const qsizetype segments) {
+
+    this->m_arena.reserve(this->m_arena.size() + headerBytes);
+    this->m_segments.reserve(this->m_segments.size() + segments);
+}
+
+void RecordChain::clear() {
+
+    // 保留 arena 与分段表的容量, 下次复用
+    this->m_arena.resize(0);
+    this->m_segments.clear();
+    this->m_bytes = 0;
+    this->m_records.clear();
+    this->m_headPartial = false;
+    this->m_begun = 0;
+}
+
+const char *RecordChain::segmentData(const qsizetype index) const {
+
+    const auto &segment = this->m_segments[index];
+    if ( segment.payload.isNull() ) {
+        return this->m_arena.constData() + segment.offset;
+    }
+    return segment.payload.constData() + segment.offset;
+}
+
+void RecordChain::consume(qsizetype bytes) {
+
+    qsizetype done = 0;
+    while ( bytes > 0 && done < this->m_segments.size() ) {
+        auto &segment = this->m_segments[done];
+        if ( bytes >= segment.len ) {
+            bytes -= segment.len;
+            this->m_bytes -= segment.len;
+            if ( this->m_tracking ) this->trackConsumed(segment.len, true);
+            done++;
+        } else {
+            segment.offset += bytes;
+            segment.len -= bytes;
+            this->m_bytes -= bytes;
+            if ( this->m_tracking ) this->trackConsumed(bytes, false);
+            bytes = 0;
+        }
+    }
+
+    if ( done == this->m_segments.size() ) {
+        this->clear();
+    } else {
+        this->m_segments.remove(0, done);
+    }
+}
+
+void RecordChain::appendTo(QByteArray &out) const {
+
+    out.reserve(out.size() + this->m_bytes);
+    for ( qsizetype i = 0; i < this->m_segments.size(); i++ ) {
+        out.append(this->segmentData(i), this->m_segments[i].len);
+    }
+}
+
+void RecordChain::setRecordTracking(const bool enable) {
+
+    this->m_tracking = enable;
+    this->m_records.clear();
+    this->m_headPartial = false;
+
+    // 已有的数据无法区分边界, 作为一条不可丢弃的记录
+    if ( enable && !this->m_segments.isEmpty() ) {
+        this->m_records.append({-1, this->m_segments.size(), this->m_bytes});
+        this->m_headPartial = true;
+    }
+}
+
+void RecordChain::beginRecord(const qint64 tag) {
+
+    if ( !this->m_tracking ) {
+        this->m_begun++;
+        return;
+    }
+
+    // 上一条记录没有数据时直接复用
+    if ( !this->m_records.isEmpty() && this->m_records.last().segments == 0 ) {
+        this->m_records.last().tag = tag;
+        return;
+    }
+    this->m_begun++;
+    this->m_records.append({tag, 0, 0});
+}
+
+qsizetype RecordChain::dropFront(const qsizetype bytes, const std::function<void(qint64, qsizetype)> &dropped) {
+
+    if ( !this->m_tracking ) return 0;
+
+    const qsizetype first = this->m_headPartial ? 1 : 0;
+    const qsizetype firstSegment = first ? this->m_records.first().segments : 0;
+
+    qsizetype last = first;
+    qsizetype segmentEnd = firstSegment;
+    qsizetype freed = 0;
+    while ( freed < bytes && last < this->m_records.size() && this->m_records[last].segments > 0 ) {
+        const auto &record = this->m_records[last];
+        freed += record.bytes;
+        segmentEnd += record.segments;
+        dropped(record.tag, record.bytes);
+        last++;
+    }
+    if ( last == first ) return 0;
+
+    this->m_segments.remove(firstSegment, segmentEnd - firstSegment);
+    this->m_records.remove(first, last - first);
+    this->m_bytes -= freed;
+    this->m_begun -= last - first;
+
+    if ( this->m_segments.isEmpty() ) {
+        this->clear();
+    } else {
+        this->compactArena();
+    }
+    return freed;
+}
+
+void RecordChain::trackSegment(const qsizetype len) {
+
+    if ( this->m_records.isEmpty() ) {
+        this->m_records.append({-1, 0, 0});
+    }
+    auto &record = this->m_records.last();
+    record.segments++;
+    record.bytes += len;
+}
+
+void RecordChain::trackConsumed(const qsizetype len, const bool segmentDone) {
+
+    auto &head = this->m_records.first();
+    head.bytes -= len;
+    this->m_headPartial = true;
+    if ( segmentDone && --head.segments == 0 ) {
+        this->m_records.removeFirst();
+        this->m_headPartial = false;
+    }
+}
+
+// 丢弃的记录在 arena 中留下空洞, 空洞较大时把存活的报文头搬到新的 arena
+void RecordChain::compactArena() {
+
+    qsizetype live = 0;
+    for ( const auto &segment : this->m_segments ) {
+        if ( segment.payload.isNull() ) live += segment.len;
+    }
+
+    const qsizetype hole = this->m_arena.size() - live;
+    if ( hole < RECORD_ARENA_COMPACT_BYTES || hole < live ) return;
+
+    QByteArray arena;
+    arena.reserve(live);
+    for ( auto &segment : this->m_segments ) {
+        if ( segment.payload.isNull() ) {
+            const qsizetype offset = arena.size();
+            arena.append(this->m_arena.constData() + segment.offset, segment.len);
+            segment.offset = offset;
+        }
+    }
+    this->m_arena = arena;
+}
@@ -0,0 +1,103 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/14.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_RECORD_CHAIN_H
+#define PRISM_RECORD_CHAIN_H
+
+#include <QByteArray>
+#include <QList>
+#include <functional>
+
+
+// 丢弃记录后 arena 中的空洞超过该值且超过存活部分时整理 arena
+#define RECORD_ARENA_COMPACT_BYTES      (64 * 1024)
+
+// 待写出的记录链
+// 报文头拷贝进一块复用的 arena, 明文数据只持有 QByteArray 引用, 写出时按 iovec 组装
+class RecordChain {
+
+public:
+    RecordChain() = default;
+
+    RecordChain(const RecordChain&) = delete;
+    RecordChain& operator=(const RecordChain&) = delete;
+
+    void appendHeader(const void *data, qsizetype len);
+    void appendPayload(const QByteArray &payload) { this->appendPayload(payload, 0, payload.size()); }
+    // 只引用 payload 中 [offset, offset + len) 的部分, 不拷贝
+    void appendPayload(const QByteArray &payload, qsizetype offset, qsizetype len);
+    // 一次性预留 arena 与分段表容量, 批量追加前调用
+    void reserve(qsizetype headerBytes, qsizetype segments);
+
+    qsizetype bytes() const { return this->m_bytes; }
+    bool isEmpty() const { return this->m_bytes == 0; }
+    void clear();
+
+    qsizetype segmentCount() const { return this->m_segments.size(); }
+    const char *segmentData(qsizetype index) const;
+    qsizetype segmentSize(qsizetype index) const { return this->m_segments[index].len; }
+
+    // 丢弃链首已经写出的字节
+    void consume(qsizetype bytes);
+    // 按顺序把整条链拷贝到 out 末尾, 供需要连续内存的压缩使用
+    void appendTo(QByteArray &out) const;
+
+    // 记录边界跟踪, 开启后每条记录从新的分段开始, 可以按整条记录从链首丢弃
+    void setRecordTracking(bool enable);
+    // 开始一条新记录, tag 标识记录所属的流
+    void beginRecord(qint64 tag);
+    // 上次 clear 以来开始的记录数, 整条链一起写出或丢弃时即为链中的记录数
+    qsizetype begunRecords() const { return this->m_begun; }
+    // 从链首按整条记录丢弃, 直到至少释放 bytes 字节, 已经写出一部分的首条记录保留
+    // 每丢弃一条记录回调一次 dropped(tag, 记录字节数), 返回实际释放的字节数
+    qsizetype dropFront(qsizetype bytes, const std::function<void(qint64, qsizetype)> &dropped);
+
+private:
+    typedef struct SEGMENT_ {
+        QByteArray  payload;        // 为空表示位于 arena
+        qsizetype   offset;
+        qsizetype   len;
+    } SEGMENT;
+
+    typedef struct RECORD_ {
+        qint64      tag;
+        qsizetype   segments;       // 记录占用的分段数
+        qsizetype   bytes;          // 记录中尚未写出的字节数
+    } RECORD;
+
+    void trackSegment(qsizetype len);
+    void trackConsumed(qsizetype len, bool segmentDone);
+    void compactArena();
+
+    QByteArray m_arena{};
+    QList<SEGMENT> m_segments{};
+    qsizetype m_bytes{0};
+
+    bool m_tracking{false};
+    QList<RECORD> m_records{};
+    // 首条记录已经写出一部分
+    bool m_headPartial{false};
+    qsizetype m_begun{0};
+};
+
+
+#endif //PRISM_RECORD_CHAIN_H
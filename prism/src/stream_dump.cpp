@@ -0,0 +1,178 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "stream_dump.h"
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "dump.h"
+
+
+static const char *directionName(const bool sendOut) {
+    return sendOut ? "tx" : "rx";
+}
+
+
+void StreamDumper::setDirectory(const QString &dirPath) {
+
+    this->closeAll();
+    this->m_dir = dirPath;
+    this->m_dirReady = false;
+}
+
+QString StreamDumper::filePath(const QString &name, const char *suffix) const {
+    return QStringLiteral("%1/%2.%3").arg(this->m_dir, name, QString::fromLatin1(suffix));
+}
+
+void StreamDumper::open(const QString &name, const FLOW_TRACK_ &flow, const qint64 timestamp) {
+
+    if ( this->m_dir.isEmpty() ) return;
+
+    if ( !this->m_dirReady ) {
+        this->m_dirReady = QDir().mkpath(this->m_dir);
+        if ( !this->m_dirReady ) return;
+    }
+
+    auto stream = QSharedPointer<STREAM_FLOW>::create();
+    stream->name = name;
+    stream->data[false].setFileName(this->filePath(name, directionName(false)));
+    stream->data[true].setFileName(this->filePath(name, directionName(true)));
+    stream->index.setFileName(this->filePath(name, "jsonl"));
+    this->m_flows.insert(name, stream);
+
+    if ( !this->activate(*stream) ) return;
+
+    QJsonObject meta;
+    meta[QStringLiteral("protocol")] = flow.protocol == PROTOCOL_TCP ? QStringLiteral("tcp") : QStringLiteral("udp");
+    meta[QStringLiteral("src")] = flow.src.toString();
+    meta[QStringLiteral("sport")] = flow.src.hostPort();
+    meta[QStringLiteral("dst")] = flow.dst.toString();
+    meta[QStringLiteral("dport")] = flow.dst.hostPort();
+    meta[QStringLiteral("domain")] = QString::fromUtf8(flow.domain);
+    meta[QStringLiteral("start")] = timestamp;
+
+    stream->index.write(QJsonDocument(meta).toJson(QJsonDocument::Compact));
+    stream->index.write("\n", 1);
+}
+
+void StreamDumper::append(const QString &name, const bool sendOut, const qint64 timestamp, const QByteArray &payload) {
+
+    const auto stream = this->m_flows.value(name);
+    if ( !stream || payload.isEmpty() || !this->activate(*stream) ) return;
+
+    auto &data = stream->data[sendOut];
+    if ( !data.isOpen() && !data.open(QIODevice::WriteOnly | QIODevice::Append) ) return;
+
+    const qint64 offset = stream->bytes[sendOut];
+    const qint64 written = data.write(payload);
+    if ( written <= 0 ) return;
+    stream->bytes[sendOut] += written;
+
+    // 逐块拼接, 避免每块构造一次 QJsonDocument
+    QByteArray line;
+    line.reserve(96);
+    line.append("{\"dir\":\"").append(directionName(sendOut))
+        .append("\",\"offset\":").append(QByteArray::number(offset))
+        .append(",\"length\":").append(QByteArray::number(written))
+        .append(",\"ts\":").append(QByteArray::number(timestamp))
+        .append("}\n");
+    stream->index.write(line);
+}
+
+void StreamDumper::skip(const QString &name, const bool sendOut, const qint64 bytes) {
+
+    if ( bytes <= 0 ) return;
+
+    const auto stream = this->m_flows.value(name);
+    if ( stream ) stream->skipped[sendOut] += bytes;
+}
+
+void StreamDumper::close(const QString &name, const qint64 timestamp) {
+
+    const auto stream = this->m_flows.take(name);
+    if ( !stream ) return;
+
+    if ( this->activate(*stream) ) {
+        QByteArray line;
+        line.append("{\"end\":").append(QByteArray::number(timestamp))
+            .append(",\"txBytes\":").append(QByteArray::number(stream->bytes[true]))
+            .append(",\"rxBytes\":").append(QByteArray::number(stream->bytes[false]))
+            .append(",\"txTruncated\":").append(QByteArray::number(stream->skipped[true]))
+            .append(",\"rxTruncated\":").append(QByteArray::number(stream->skipped[false]))
+            .append("}\n");
+        stream->index.write(line);
+    }
+    this->deactivate(*stream);
+}
+
+void StreamDumper::flush() {
+
+    for ( const auto stream : this->m_lru ) {
+        stream->data[false].flush();
+        stream->data[true].flush();
+        stream->index.flush();
+    }
+}
+
+void StreamDumper::closeAll() {
+
+    while ( !this->m_lru.empty() ) {
+        this->deactivate(*this->m_lru.back());
+    }
+    this->m_flows.clear();
+}
+
+// 确保流的 sidecar 已打开并移到 LRU 表头, 数据文件在第一次写入该方向时才打开
+bool StreamDumper::activate(STREAM_FLOW &flow) {
+
+    if ( flow.active ) {
+        this->m_lru.splice(this->m_lru.begin(), this->m_lru, flow.lru);
+        return true;
+    }
+
+    while ( this->m_lru.size() >= STREAM_MAX_OPEN_FLOWS ) {
+        this->deactivate(*this->m_lru.back());
+    }
+
+    if ( !flow.index.open(QIODevice::WriteOnly | QIODevice::Append) ) {
+        return false;
+    }
+
+    this->m_lru.push_front(&flow);
+    flow.lru = this->m_lru.begin();
+    flow.active = true;
+    ++this->m_openFlows;
+    return true;
+}
+
+void StreamDumper::deactivate(STREAM_FLOW &flow) {
+
+    if ( !flow.active ) return;
+
+    flow.data[false].close();
+    flow.data[true].close();
+    flow.index.close();
+
+    this->m_lru.erase(flow.lru);
+    flow.active = false;
+    --this->m_openFlows;
+}
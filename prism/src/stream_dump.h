@@ -0,0 +1,93 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/16.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_STREAM_DUMP_H
+#define PRISM_STREAM_DUMP_H
+
+#include <QFile>
+#include <QHash>
+#include <QSharedPointer>
+#include <atomic>
+#include <list>
+
+
+// 同时保持打开的流数上限, 每个流最多占用 3 个文件描述符
+#define STREAM_MAX_OPEN_FLOWS       256
+
+
+struct FLOW_TRACK_;
+
+
+// 原始流输出
+// 每个流两个方向的明文各自追加写入一个文件 (<name>.tx / <name>.rx), 不构造任何报文头
+// 旁边的 <name>.jsonl 第一行为流的五元组与域名, 之后每行记录一个数据块的方向, 偏移, 长度与时间戳, 最后一行为结束时间, 总字节数与截掉的字节数
+// 时间戳均为纳秒 UTC
+// 打开的文件按 LRU 管理, 超过上限时关闭最久未写入的流, 再次写入时以追加方式重新打开
+class StreamDumper {
+
+public:
+    StreamDumper() = default;
+    ~StreamDumper() { this->closeAll(); }
+
+    StreamDumper(const StreamDumper&) = delete;
+    StreamDumper& operator=(const StreamDumper&) = delete;
+
+    // 本次抓包的输出目录, 第一个流打开时创建
+    void setDirectory(const QString &dirPath);
+
+    void open(const QString &name, const FLOW_TRACK_ &flow, qint64 timestamp);
+    void append(const QString &name, bool sendOut, qint64 timestamp, const QByteArray &payload);
+    // 超出预算未写入的字节, 只计数, 记录在结束行中
+    void skip(const QString &name, bool sendOut, qint64 bytes);
+    void close(const QString &name, qint64 timestamp);
+
+    void flush();
+    void closeAll();
+
+    // 当前打开的流数, 任意线程读取
+    unsigned int openFlows() const { return this->m_openFlows; }
+
+private:
+    typedef struct STREAM_FLOW_ {
+        QString                         name;
+        QFile                           data[2];        // 下标为 sendOut
+        QFile                           index;
+        qint64                          bytes[2] = {};  // 已写出的字节数, 即下一个数据块的偏移
+        qint64                          skipped[2] = {};
+        bool                            active = false;
+        std::list<STREAM_FLOW_ *>::iterator lru{};
+    } STREAM_FLOW;
+
+    bool activate(STREAM_FLOW &flow);
+    void deactivate(STREAM_FLOW &flow);
+    QString filePath(const QString &name, const char *suffix) const;
+
+    QString m_dir{};
+    bool m_dirReady{false};
+    QHash<QString, QSharedPointer<STREAM_FLOW>> m_flows{};
+    // 表头为最近写入的流
+    std::list<STREAM_FLOW *> m_lru{};
+    std::atomic<unsigned int> m_openFlows{0};
+};
+
+
+#endif //PRISM_STREAM_DUMP_H
@@ -32,6 +32,9 @@
 #include <QButtonGroup>
 #include <QStandardPaths>
 #include "config.hpp"
+#include "capture_file.h"
+#include "filter.h"
+#include "dump.h"
 #include "misc.h"
 
 
@@ -48,6 +51,25 @@ ConfigView::ConfigView(QWidget *parent, const Qt::WindowFlags f) : QDialog(paren
     this->passwordLine = new QLineEdit(this);
     this->runAsShadowsocks = new QRadioButton(QStringLiteral("SHADOWSOCKS"), this);
     this->runAsSocks5 = new QRadioButton(QStringLiteral("SOCKS5"), this);
+    this->dumpInThreadCheck = new QCheckBox(QStringLiteral("WRITER THREAD"), this);
+    this->formatCombo = new QComboBox(this);
+    this->checksumCheck = new QCheckBox(QStringLiteral("CHECKSUM"), this);
+    this->leanCheck = new QCheckBox(QStringLiteral("LEAN"), this);
+    this->indexCheck = new QCheckBox(QStringLiteral("INDEX"), this);
+    this->codecCombo = new QComboBox(this);
+    this->ioCombo = new QComboBox(this);
+    this->fsyncCheck = new QCheckBox(QStringLiteral("FSYNC"), this);
+    this->rotateSizeSpin = new QSpinBox(this);
+    this->rotateTimeSpin = new QSpinBox(this);
+    this->rotateFilesSpin = new QSpinBox(this);
+    this->mssSpin = new QSpinBox(this);
+    this->coalesceTimeSpin = new QSpinBox(this);
+    this->coalesceBytesSpin = new QSpinBox(this);
+    this->budgetTxSpin = new QSpinBox(this);
+    this->budgetRxSpin = new QSpinBox(this);
+    this->filterLine = new QLineEdit(this);
+    this->memLimitSpin = new QSpinBox(this);
+    this->dropPolicyCombo = new QComboBox(this);
 
 
     auto path = QStringLiteral("%1/res/root.crt").arg(MiscFuncs::getExecutableRootPath());
@@ -96,6 +118,84 @@ ConfigView::ConfigView(QWidget *parent, const Qt::WindowFlags f) : QDialog(paren
     this->runAsSocks5->setChecked(true);
     this->passwordLine->setEnabled(false);
 
+    this->dumpInThreadCheck->setChecked(true);
+    this->formatCombo->addItem(QStringLiteral("PCAP"), CAPTURE_FORMAT_PCAP);
+    this->formatCombo->addItem(QStringLiteral("PCAPNG"), CAPTURE_FORMAT_PCAPNG);
+    this->formatCombo->addItem(QStringLiteral("RAW STREAM"), CAPTURE_FORMAT_RAW);
+    this->formatCombo->setCurrentIndex(0);
+    this->checksumCheck->setChecked(false);
+    this->leanCheck->setChecked(false);
+    this->indexCheck->setChecked(true);
+
+    this->codecCombo->addItem(QStringLiteral("NONE"), CAPTURE_CODEC_NONE);
+    this->codecCombo->addItem(QStringLiteral("GZIP"), CAPTURE_CODEC_GZIP);
+    if ( CaptureCodec::available(CAPTURE_CODEC_ZSTD) ) {
+        this->codecCombo->addItem(QStringLiteral("ZSTD"), CAPTURE_CODEC_ZSTD);
+    }
+    this->codecCombo->setCurrentIndex(0);
+
+    this->ioCombo->addItem(QStringLiteral("FILE"), CAPTURE_IO_FILE);
+    if ( CaptureFile::ioSupported(CAPTURE_IO_MMAP) ) {
+        this->ioCombo->addItem(QStringLiteral("MMAP"), CAPTURE_IO_MMAP);
+    }
+    if ( CaptureFile::ioSupported(CAPTURE_IO_URING) ) {
+        this->ioCombo->addItem(QStringLiteral("IO_URING"), CAPTURE_IO_URING);
+    }
+    this->ioCombo->setCurrentIndex(0);
+
+    // 只对 io_uring 有效
+    this->fsyncCheck->setChecked(false);
+    this->fsyncCheck->setEnabled(false);
+
+    // 0 表示不轮转/不限数量
+    this->rotateSizeSpin->setRange(0, 1024 * 1024);
+    this->rotateSizeSpin->setSuffix(QStringLiteral(" MB"));
+    this->rotateSizeSpin->setValue(0);
+    this->rotateTimeSpin->setRange(0, 7 * 24 * 60 * 60);
+    this->rotateTimeSpin->setSuffix(QStringLiteral(" S"));
+    this->rotateTimeSpin->setValue(0);
+    this->rotateFilesSpin->setRange(0, 100000);
+    this->rotateFilesSpin->setValue(0);
+
+    // 0 表示按地址族取默认值 (IPv4 1460, IPv6 1440)
+    this->mssSpin->setRange(0, 9000);
+    this->mssSpin->setSpecialValueText(QStringLiteral("AUTO"));
+    this->mssSpin->setValue(0);
+
+    // 0 微秒表示不合并, 0 字节表示合并到一个 MSS
+    this->coalesceTimeSpin->setRange(0, 1000 * 1000);
+    this->coalesceTimeSpin->setSuffix(QStringLiteral(" US"));
+    this->coalesceTimeSpin->setSpecialValueText(QStringLiteral("OFF"));
+    this->coalesceTimeSpin->setValue(0);
+    this->coalesceBytesSpin->setRange(0, 1024 * 1024);
+    this->coalesceBytesSpin->setSuffix(QStringLiteral(" B"));
+    this->coalesceBytesSpin->setSpecialValueText(QStringLiteral("MSS"));
+    this->coalesceBytesSpin->setValue(0);
+
+    // 0 表示不限
+    this->budgetTxSpin->setRange(0, 1024 * 1024);
+    this->budgetTxSpin->setPrefix(QStringLiteral("TX "));
+    this->budgetTxSpin->setSuffix(QStringLiteral(" KB"));
+    this->budgetTxSpin->setSpecialValueText(QStringLiteral("TX UNLIMITED"));
+    this->budgetTxSpin->setValue(0);
+    this->budgetRxSpin->setRange(0, 1024 * 1024);
+    this->budgetRxSpin->setPrefix(QStringLiteral("RX "));
+    this->budgetRxSpin->setSuffix(QStringLiteral(" KB"));
+    this->budgetRxSpin->setSpecialValueText(QStringLiteral("RX UNLIMITED"));
+    this->budgetRxSpin->setValue(0);
+
+    // 写盘失败时待写记录的内存上限, 0 表示不限
+    this->memLimitSpin->setRange(0, 64 * 1024);
+    this->memLimitSpin->setSuffix(QStringLiteral(" MB"));
+    this->memLimitSpin->setSpecialValueText(QStringLiteral("UNLIMITED"));
+    this->memLimitSpin->setValue(CACHING_LIMIT_DEFAULT_MB);
+    this->dropPolicyCombo->addItem(QStringLiteral("DROP NEWEST"), DUMP_DROP_NEWEST);
+    this->dropPolicyCombo->addItem(QStringLiteral("DROP OLDEST"), DUMP_DROP_OLDEST);
+    this->dropPolicyCombo->addItem(QStringLiteral("METADATA ONLY"), DUMP_DROP_METADATA);
+    this->dropPolicyCombo->setCurrentIndex(0);
+
+    this->filterLine->setPlaceholderText(QStringLiteral("tcp and (domain *.example.com or port 8000-8999)"));
+
     // ReSharper disable once CppDFAMemoryLeak
     const auto btnSelectCrt = new QPushButton(QStringLiteral("SELECT"), this);
     QObject::connect(
@@ -129,6 +229,25 @@ ConfigView::ConfigView(QWidget *parent, const Qt::WindowFlags f) : QDialog(paren
         [this]() { this->onSelectClicked(SELECT_HOST); }
     );
 
+    QObject::connect(
+        this->ioCombo,
+        &QComboBox::currentIndexChanged,
+        this,
+        [this]() { this->fsyncCheck->setEnabled(this->ioCombo->currentData().toInt() == CAPTURE_IO_URING); }
+        );
+
+    // 压缩只能在写线程中进行, 否则会阻塞中继线程
+    QObject::connect(
+        this->codecCombo,
+        &QComboBox::currentIndexChanged,
+        this,
+        [this]() {
+            const bool compressed = this->codecCombo->currentData().toInt() != CAPTURE_CODEC_NONE;
+            if ( compressed ) this->dumpInThreadCheck->setChecked(true);
+            this->dumpInThreadCheck->setEnabled(!compressed);
+        }
+        );
+
     QObject::connect(
         this->runAsShadowsocks,
         &QRadioButton::clicked,
@@ -158,6 +277,24 @@ ConfigView::ConfigView(QWidget *parent, const Qt::WindowFlags f) : QDialog(paren
     const auto labelPcap = new QLabel(QStringLiteral("PKTS: "), this);
     // ReSharper disable once CppDFAMemoryLeak
     const auto labelHost = new QLabel(QStringLiteral("HOST: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelCodec = new QLabel(QStringLiteral("CODEC: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelIo = new QLabel(QStringLiteral("IO: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelRotate = new QLabel(QStringLiteral("ROTATE: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelFiles = new QLabel(QStringLiteral("FILES: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelMss = new QLabel(QStringLiteral("MSS: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelBudget = new QLabel(QStringLiteral("BUDGET: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelCoalesce = new QLabel(QStringLiteral("COALESCE: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelFilter = new QLabel(QStringLiteral("FILTER: "), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto labelMemory = new QLabel(QStringLiteral("MEMORY: "), this);
 
     // ReSharper disable once CppDFAMemoryLeak
     const auto hlayoutAddr = new QHBoxLayout();
@@ -204,6 +341,47 @@ ConfigView::ConfigView(QWidget *parent, const Qt::WindowFlags f) : QDialog(paren
     hlayoutHosts->addWidget(this->hostFileLine);
     hlayoutHosts->addWidget(btnSelectHost);
 
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto hlayoutDump = new QHBoxLayout();
+    hlayoutDump->addWidget(this->dumpInThreadCheck);
+    hlayoutDump->addWidget(this->formatCombo);
+    hlayoutDump->addWidget(this->checksumCheck);
+    hlayoutDump->addWidget(this->leanCheck);
+    hlayoutDump->addWidget(this->indexCheck);
+    hlayoutDump->addStretch();
+    hlayoutDump->addWidget(labelCodec);
+    hlayoutDump->addWidget(this->codecCombo);
+    hlayoutDump->addWidget(labelIo);
+    hlayoutDump->addWidget(this->ioCombo);
+    hlayoutDump->addWidget(this->fsyncCheck);
+
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto hlayoutRotate = new QHBoxLayout();
+    hlayoutRotate->addWidget(labelRotate);
+    hlayoutRotate->addWidget(this->rotateSizeSpin, 1);
+    hlayoutRotate->addWidget(this->rotateTimeSpin, 1);
+    hlayoutRotate->addWidget(labelFiles);
+    hlayoutRotate->addWidget(this->rotateFilesSpin, 1);
+    hlayoutRotate->addWidget(labelMss);
+    hlayoutRotate->addWidget(this->mssSpin, 1);
+    hlayoutRotate->addWidget(labelCoalesce);
+    hlayoutRotate->addWidget(this->coalesceTimeSpin, 1);
+    hlayoutRotate->addWidget(this->coalesceBytesSpin, 1);
+
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto hlayoutBudget = new QHBoxLayout();
+    hlayoutBudget->addWidget(labelBudget);
+    hlayoutBudget->addWidget(this->budgetTxSpin, 1);
+    hlayoutBudget->addWidget(this->budgetRxSpin, 1);
+    hlayoutBudget->addWidget(labelMemory);
+    hlayoutBudget->addWidget(this->memLimitSpin, 1);
+    hlayoutBudget->addWidget(this->dropPolicyCombo);
+
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto hlayoutFilter = new QHBoxLayout();
+    hlayoutFilter->addWidget(labelFilter);
+    hlayoutFilter->addWidget(this->filterLine, 1);
+
     // ReSharper disable once CppDFAMemoryLeak
     const auto hlayoutMode = new QHBoxLayout();
     hlayoutMode->addWidget(this->runAsShadowsocks);
@@ -253,11 +431,22 @@ ConfigView::ConfigView(QWidget *parent, const Qt::WindowFlags f) : QDialog(paren
     layoutgb2->addLayout(hlayoutHosts);
     gb2->setLayout(layoutgb2);
 
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto gb3 = new QGroupBox(QStringLiteral("Capture"), this);
+    // ReSharper disable once CppDFAMemoryLeak
+    const auto layoutgb3 = new QVBoxLayout();
+    layoutgb3->addLayout(hlayoutDump);
+    layoutgb3->addLayout(hlayoutRotate);
+    layoutgb3->addLayout(hlayoutBudget);
+    layoutgb3->addLayout(hlayoutFilter);
+    gb3->setLayout(layoutgb3);
+
     // ReSharper disable once CppDFAMemoryLeak
     const auto layout = new QVBoxLayout();
     layout->addLayout(hlayoutMode);
     layout->addWidget(gb1);
     layout->addWidget(gb2);
+    layout->addWidget(gb3);
     layout->addStretch();
     layout->addLayout(hlayoutAction);
     layout->setSpacing(0);
@@ -321,9 +510,40 @@ void ConfigView::onConfirmClicked() {
     }
     ConfigVars::instance().hostFile = str;
 
+    str = this->filterLine->text().trimmed();
+    QString filterError;
+    if ( !CaptureFilter().compile(str, &filterError) ) {
+        QToolTip::showText(QCursor::pos(), QStringLiteral("Invalid Filter: %1").arg(filterError));
+        return;
+    }
+    ConfigVars::instance().captureFilter = str;
+
+    if ( this->codecCombo->currentData().toInt() != CAPTURE_CODEC_NONE && !this->dumpInThreadCheck->isChecked() ) {
+        QToolTip::showText(QCursor::pos(), QStringLiteral("Compression Requires Writer Thread"));
+        return;
+    }
+
     str = this->methodLine->text().trimmed();
     ConfigVars::instance().method = str;
     ConfigVars::instance().runAsSocks5 = this->runAsSocks5->isChecked();
+    ConfigVars::instance().dumpInThread = this->dumpInThreadCheck->isChecked();
+    ConfigVars::instance().dumpFormat = this->formatCombo->currentData().toInt();
+    ConfigVars::instance().dumpChecksum = this->checksumCheck->isChecked();
+    ConfigVars::instance().dumpLean = this->leanCheck->isChecked();
+    ConfigVars::instance().dumpIndex = this->indexCheck->isChecked();
+    ConfigVars::instance().dumpCodec = this->codecCombo->currentData().toInt();
+    ConfigVars::instance().dumpIo = this->ioCombo->currentData().toInt();
+    ConfigVars::instance().dumpFsync = this->fsyncCheck->isChecked();
+    ConfigVars::instance().rotateMegaBytes = this->rotateSizeSpin->value();
+    ConfigVars::instance().rotateSeconds = this->rotateTimeSpin->value();
+    ConfigVars::instance().rotateFiles = this->rotateFilesSpin->value();
+    ConfigVars::instance().dumpMss = this->mssSpin->value();
+    ConfigVars::instance().coalesceMicroseconds = this->coalesceTimeSpin->value();
+    ConfigVars::instance().coalesceBytes = this->coalesceBytesSpin->value();
+    ConfigVars::instance().budgetTxKiloBytes = this->budgetTxSpin->value();
+    ConfigVars::instance().budgetRxKiloBytes = this->budgetRxSpin->value();
+    ConfigVars::instance().cachingLimitMegaBytes = this->memLimitSpin->value();
+    ConfigVars::instance().dropPolicy = this->dropPolicyCombo->currentData().toInt();
 
     emit this->configConfirm();
     this->close();
@@ -346,7 +566,7 @@ void ConfigView::onSelectClicked(const int reason) {
         break;
     case SELECT_PKT:
         save = true;
-        filter = QStringLiteral("Pkt File (*.pcap)");
+        filter = QStringLiteral("Pkt File (*.pcap *.pcapng *.gz *.zst)");
         break;
     default:
         break;
@@ -27,6 +27,8 @@
 #include <QLineEdit>
 #include <QSpinBox>
 #include <QRadioButton>
+#include <QCheckBox>
+#include <QComboBox>
 
 
 #define SELECT_CRT      1
@@ -59,6 +61,26 @@ private:
     QRadioButton *runAsShadowsocks;
     QRadioButton *runAsSocks5;
 
+    QCheckBox *dumpInThreadCheck;
+    QComboBox *formatCombo;
+    QCheckBox *checksumCheck;
+    QCheckBox *leanCheck;
+    QCheckBox *indexCheck;
+    QComboBox *codecCombo;
+    QComboBox *ioCombo;
+    QCheckBox *fsyncCheck;
+    QSpinBox *rotateSizeSpin;
+    QSpinBox *rotateTimeSpin;
+    QSpinBox *rotateFilesSpin;
+    QSpinBox *mssSpin;
+    QSpinBox *coalesceTimeSpin;
+    QSpinBox *coalesceBytesSpin;
+    QSpinBox *budgetTxSpin;
+    QSpinBox *budgetRxSpin;
+    QLineEdit *filterLine;
+    QSpinBox *memLimitSpin;
+    QComboBox *dropPolicyCombo;
+
     void onConfirmClicked();
     void onSelectClicked(int reason);
 };
@@ -26,6 +26,7 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QTimer>
+#include <QSet>
 #include "define.h"
 #include "misc.h"
 
@@ -251,11 +252,14 @@ void FlowView::onClearClicked() {
 
 void FlowView::onTimeout() {
     const auto newNodes = FlowDumper::instance().all();
+    QSet<qint64> liveKeys;
+    liveKeys.reserve(newNodes.size());
 
     // 首先遍历最新的flows, 创建不存在的, 更新需要更新的
     for (auto &node : newNodes) {
         // 是否存在
         const auto key = MiscFuncs::genFlowKey(node->isStream, node->index);
+        liveKeys.insert(key);
         auto it = this->m_lastFlowNodes.find(key);
         if (it != this->m_lastFlowNodes.end()) {
             this->updateFlowLine(node, it.value());
@@ -268,14 +272,7 @@ void FlowView::onTimeout() {
     auto it = this->m_lastFlowNodes.begin();
     while (it != this->m_lastFlowNodes.end()) {
         const auto line = it.value();
-
-        bool found = false;
-        for (const auto &node : newNodes) {
-            if (line->last.index == node->index && line->last.isStream == node->isStream) {
-                found = true;
-                break;
-            }
-        }
+        const bool found = liveKeys.contains(it.key());
 
         bool shouldErase = false;
         if (!found) {
@@ -335,8 +332,8 @@ QVariant FlowViewListModel::data(const QModelIndex &index, int role) const {
         switch ( index.column() ) {
             case Flow_Time:     return line->last.createTime.toString(QStringLiteral("hh:mm:ss"));
             case Flow_Type:     return line->last.isStream ? "TCP" : "UDP";
-            case Flow_Src:      return QStringLiteral("%1:%2").arg(line->last.localAddr, QString::number(line->last.localPort));
-            case Flow_Dst:      return QStringLiteral("%1:%2").arg(line->last.remoteAddr, QString::number(line->last.remotePort));
+            case Flow_Src:      return line->src;
+            case Flow_Dst:      return line->dst;
             case Flow_RxRate:   return QStringLiteral("%1/s").arg(MiscFuncs::formatBytes(line->rxBytesDelta));
             case Flow_TxRate:   return QStringLiteral("%1/s").arg(MiscFuncs::formatBytes(line->txBytesDelta));
             case Flow_RxBytes:  return MiscFuncs::formatBytes(line->last.rxBytes);
@@ -25,6 +25,7 @@
 
 #include <QWidget>
 #include <QStandardItemModel>
+#include <QHash>
 #include <utility>
 #include "searchable_treeview.h"
 #include "flow.h"
@@ -45,6 +46,12 @@ struct FLOW_LINE {
 
     explicit FLOW_LINE(FLOW_NODE node) : last(std::move(node)) {
 
+        // 地址文本只在行创建时生成一次
+        this->src = QStringLiteral("%1:%2").arg(this->last.local.toString(), QString::number(this->last.local.hostPort()));
+        this->dst = QStringLiteral("%1:%2").arg(
+            this->last.domain.isEmpty() ? this->last.remote.toString() : QString::fromUtf8(this->last.domain),
+            QString::number(this->last.remote.hostPort()));
+
         this->teardown = false;
         this->item = nullptr;
         this->timeInState = 0;
@@ -58,12 +65,14 @@ struct FLOW_LINE {
     bool teardown;
     int timeInState;
 
-    unsigned int rxBytesDelta;
-    unsigned int txBytesDelta;
+    unsigned long long rxBytesDelta;
+    unsigned long long txBytesDelta;
 
     FlowState state;
 
     FLOW_NODE last;
+    QString src;
+    QString dst;
     QStandardItem *item;
 };
 Q_DECLARE_METATYPE(QSharedPointer<FLOW_LINE>)
@@ -91,7 +100,7 @@ private:
     SearchableTreeView *m_treeView = nullptr;
     FlowViewListModel *m_treeModel = nullptr;
 
-    QMap<QString, QSharedPointer<FLOW_LINE>> m_lastFlowNodes;
+    QHash<qint64, QSharedPointer<FLOW_LINE>> m_lastFlowNodes;
 
     void createNewFlowLine(const QSharedPointer<FLOW_NODE> &newNode);
     void updateFlowLine(const QSharedPointer<FLOW_NODE> &node, const QSharedPointer<FLOW_LINE> &line) const;
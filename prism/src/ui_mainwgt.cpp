@@ -125,12 +125,36 @@ void MainWidget::onConfigConfirm() {
 
     this->m_hostsView->setHostsPath(ConfigVars::instance().hostFile);
     PacketDumper::instance().setPcapFilePath(ConfigVars::instance().pktFile);
+    PacketDumper::instance().setCaptureFormat(static_cast<CAPTURE_FORMAT>(ConfigVars::instance().dumpFormat));
+    PacketDumper::instance().setCaptureCodec(static_cast<CAPTURE_CODEC>(ConfigVars::instance().dumpCodec));
+    PacketDumper::instance().setCaptureIo(
+        static_cast<CAPTURE_IO>(ConfigVars::instance().dumpIo),
+        ConfigVars::instance().dumpFsync);
+    PacketDumper::instance().setRotation(
+        static_cast<qint64>(ConfigVars::instance().rotateMegaBytes) * 1024 * 1024,
+        ConfigVars::instance().rotateSeconds,
+        ConfigVars::instance().rotateFiles);
+    PacketDumper::instance().setTcpMss(ConfigVars::instance().dumpMss);
+    PacketDumper::instance().setCoalescing(ConfigVars::instance().coalesceMicroseconds, ConfigVars::instance().coalesceBytes);
+    PacketDumper::instance().setFlowBudget(
+        static_cast<qint64>(ConfigVars::instance().budgetTxKiloBytes) * 1024,
+        static_cast<qint64>(ConfigVars::instance().budgetRxKiloBytes) * 1024);
+    PacketDumper::instance().setChecksums(ConfigVars::instance().dumpChecksum);
+    PacketDumper::instance().setLeanCapture(ConfigVars::instance().dumpLean);
+    PacketDumper::instance().setCaptureIndex(ConfigVars::instance().dumpIndex);
+    PacketDumper::instance().setCachingLimit(
+        static_cast<qint64>(ConfigVars::instance().cachingLimitMegaBytes) * 1024 * 1024,
+        static_cast<DUMP_DROP_POLICY>(ConfigVars::instance().dropPolicy));
+    // 表达式已在配置界面校验过
+    PacketDumper::instance().setCaptureFilter(ConfigVars::instance().captureFilter);
 
     this->captureStart();
 }
 
 void MainWidget::captureStart() {
 
+    PacketDumper::instance().start(ConfigVars::instance().dumpInThread);
+
     if (ConfigVars::instance().runAsSocks5) {
         StartSocks5CryptoServer(
             ConfigVars::instance().listenPort,
@@ -158,6 +182,9 @@ void MainWidget::captureStop() {
     StopSocks5CryptoServer();
     StopShadowsocksCryptoServer();
 
+    // 中继线程已退出, 剩余的抓包数据落盘
+    PacketDumper::instance().stop();
+
     this->m_capturing = false;
     this->updateStatus();
 }
@@ -33,6 +33,7 @@
 #include "if_raw.h"
 #include "config.hpp"
 #include "dump.h"
+#include "checksum.h"
 
 
 typedef enum {
@@ -51,7 +52,21 @@ typedef enum {
     KeyFile,
     PktFile,
     HostsFile,
-    BytesCaching
+    BytesCaching,
+    CachingLimit,
+    CachingDrops,
+    DumpQueue,
+    DumpDrops,
+    WriteLatency,
+    IoErrors,
+    DumpFiles,
+    CodecRatio,
+    CodecCpu,
+    ChecksumKernel,
+    OpenStreams,
+    Truncated,
+    Filtered,
+    Coalesced
 } STATICS_NAME_INDEX;
 
 
@@ -75,6 +90,20 @@ static const NAMEINDEX Labels[] = {
     CREATESTRMAP(HostsFile),
 
     CREATESTRMAP(BytesCaching),
+    CREATESTRMAP(CachingLimit),
+    CREATESTRMAP(CachingDrops),
+    CREATESTRMAP(DumpQueue),
+    CREATESTRMAP(DumpDrops),
+    CREATESTRMAP(WriteLatency),
+    CREATESTRMAP(IoErrors),
+    CREATESTRMAP(DumpFiles),
+    CREATESTRMAP(CodecRatio),
+    CREATESTRMAP(CodecCpu),
+    CREATESTRMAP(ChecksumKernel),
+    CREATESTRMAP(OpenStreams),
+    CREATESTRMAP(Truncated),
+    CREATESTRMAP(Filtered),
+    CREATESTRMAP(Coalesced),
 };
 
 
@@ -88,6 +117,15 @@ static NAMEINDEX OprtName[] = {
     CREATECONNECTEDMAP(Statics, Value),
 };
 
+static QString DropPolicyName(const DUMP_DROP_POLICY policy) {
+    switch ( policy ) {
+    case DUMP_DROP_NEWEST:      return QStringLiteral("DROP NEWEST");
+    case DUMP_DROP_OLDEST:      return QStringLiteral("DROP OLDEST");
+    case DUMP_DROP_METADATA:    return QStringLiteral("METADATA ONLY");
+    }
+    return {};
+}
+
 StatisticsView::StatisticsView(QWidget *parent, const Qt::WindowFlags f) : QDialog(parent, f) {
 
     QStringList labels;
@@ -205,6 +243,7 @@ QVariant StaticsTreeViewModel::data(const QModelIndex &index, int role) const {
     if ( 1 == index.column() ) {
 
         const auto statistics = GetFlowStats();
+        const auto dumpStats = PacketDumper::instance().getDumpStats();
 
         switch ( index.row() ) {
         case Mode:          return QStringLiteral("%1").arg(ConfigVars::instance().runAsSocks5 ? "SOCKS5" : "SHADOWSOCKS");
@@ -223,6 +262,20 @@ QVariant StaticsTreeViewModel::data(const QModelIndex &index, int role) const {
         case PktFile:       return QStringLiteral("%1").arg(ConfigVars::instance().pktFile);
         case HostsFile:     return QStringLiteral("%1").arg(ConfigVars::instance().hostFile);
         case BytesCaching:  return QStringLiteral("%1").arg(MiscFuncs::formatBytes(PacketDumper::instance().getCachingBytes()));
+        case CachingLimit:  return dumpStats.cachingLimit ? QStringLiteral("%1MB %2").arg(QString::number(dumpStats.cachingLimit / 1024 / 1024), DropPolicyName(dumpStats.dropPolicy)) : QStringLiteral("-");
+        case CachingDrops:  return QStringLiteral("%1/%2B/%3 flows").arg(QString::number(dumpStats.drops), QString::number(dumpStats.dropBytes), QString::number(dumpStats.dropFlows));
+        case DumpQueue:     return dumpStats.threaded ? QStringLiteral("%1/%2").arg(QString::number(dumpStats.queueDepth), QString::number(dumpStats.queueCapacity)) : QStringLiteral("-");
+        case DumpDrops:     return QStringLiteral("%1").arg(dumpStats.queueDrops);
+        case WriteLatency:  return QStringLiteral("%1us/%2us").arg(QString::number(dumpStats.writeLatencyUs), QString::number(dumpStats.writeLatencyMaxUs));
+        case IoErrors:      return QStringLiteral("%1").arg(dumpStats.ioErrors);
+        case DumpFiles:     return QStringLiteral("%1").arg(dumpStats.filesOpened);
+        case CodecRatio:    return dumpStats.codecBytes ? QStringLiteral("%1x").arg(static_cast<double>(dumpStats.codecRawBytes) / static_cast<double>(dumpStats.codecBytes), 0, 'f', 2) : QStringLiteral("-");
+        case CodecCpu:      return QStringLiteral("%1ms").arg(dumpStats.codecCpuUs / 1000);
+        case OpenStreams:   return QStringLiteral("%1").arg(dumpStats.openStreams);
+        case Truncated:     return QStringLiteral("%1").arg(dumpStats.truncatedBytes);
+        case Filtered:      return QStringLiteral("%1").arg(dumpStats.filteredFlows);
+        case Coalesced:     return QStringLiteral("%1").arg(dumpStats.coalescedChunks);
+        case ChecksumKernel:return ConfigVars::instance().dumpChecksum ? QStringLiteral("%1").arg(Checksum::kernel()) : QStringLiteral("-");
 
         default: break;
         }
@@ -0,0 +1,398 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/18.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "uring_writer.h"
+
+#ifdef PRISM_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// fdatasync 请求的 user_data, 写请求使用缓冲区下标
+#define URING_SYNC_TAG              (~0ull)
+
+
+bool UringWriter::supported() {
+    return true;
+}
+
+int UringWriter::enter(const unsigned toSubmit, const unsigned minComplete, const unsigned flags) {
+
+    int ret;
+    do {
+        ret = static_cast<int>(syscall(__NR_io_uring_enter, this->m_ringFd, toSubmit, minComplete, flags, nullptr, 0));
+    } while ( ret < 0 && errno == EINTR );
+
+    if ( ret > 0 ) {
+        this->m_pending -= ret;
+        this->m_inflight += ret;
+    }
+    return ret;
+}
+
+bool UringWriter::setup(const int fd, const bool syncEachFlush) {
+
+    this->teardown();
+
+    io_uring_params params = {};
+    const int ringFd = static_cast<int>(syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &params));
+    if ( ringFd < 0 ) {
+        // ENOSYS: 内核不支持; EPERM: 被 seccomp 或 sysctl 禁用
+        return false;
+    }
+
+    this->m_ringFd = ringFd;
+    this->m_fd = fd;
+    this->m_failures = 0;
+    this->m_failedAt = -1;
+    this->m_syncEachFlush = syncEachFlush;
+
+    this->m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if ( single ) {
+        this->m_sqRingSize = this->m_cqRingSize = qMax(this->m_sqRingSize, this->m_cqRingSize);
+    }
+
+    this->m_sqRing = mmap(nullptr, this->m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd, IORING_OFF_SQ_RING);
+    if ( this->m_sqRing == MAP_FAILED ) {
+        this->m_sqRing = nullptr;
+        this->teardown();
+        return false;
+    }
+
+    if ( single ) {
+        this->m_cqRing = this->m_sqRing;
+    } else {
+        this->m_cqRing = mmap(nullptr, this->m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ringFd, IORING_OFF_CQ_RING);
+        if ( this->m_cqRing == MAP_FAILED ) {
+            this->m_cqRing = nullptr;
+            this->teardown();
+            return false;
+        }
+    }
+
+    this->m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    this->m_sqes = mmap(nullptr, this->m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_SQES);
+    if ( this->m_sqes == MAP_FAILED ) {
+        this->m_sqes = nullptr;
+        this->teardown();
+        return false;
+    }
+
+    auto *sq = static_cast<char *>(this->m_sqRing);
+    auto *cq = static_cast<char *>(this->m_cqRing);
+    this->m_sqHead  = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    this->m_sqTail  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    this->m_sqMask  = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    this->m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    this->m_cqHead  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    this->m_cqTail  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    this->m_cqMask  = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    this->m_cqes    = cq + params.cq_off.cqes;
+
+    void *arena = mmap(nullptr, URING_BUFFER_COUNT * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( arena == MAP_FAILED ) {
+        this->teardown();
+        return false;
+    }
+    this->m_arena = static_cast<char *>(arena);
+
+    iovec iov[URING_BUFFER_COUNT];
+    this->m_buffers.resize(URING_BUFFER_COUNT);
+    for ( int i = 0; i < URING_BUFFER_COUNT; i++ ) {
+        auto &buffer = this->m_buffers[i];
+        buffer = {};
+        buffer.data = this->m_arena + static_cast<size_t>(i) * URING_BUFFER_SIZE;
+        iov[i].iov_base = buffer.data;
+        iov[i].iov_len = URING_BUFFER_SIZE;
+    }
+
+    // RLIMIT_MEMLOCK 不足时注册会失败, 退回 WRITEV, 其余流程不变
+    this->m_fixed = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iov, URING_BUFFER_COUNT) == 0;
+
+    return true;
+}
+
+void UringWriter::teardown() {
+
+    if ( this->m_ringFd >= 0 && this->m_sqes ) {
+        // 已经失败时不再提交, 还在 SQ 中的请求随 ring 一起丢弃
+        this->submit();
+        while ( this->m_inflight > 0 ) {
+            this->reap(true);
+        }
+    }
+
+    if ( this->m_arena ) {
+        munmap(this->m_arena, URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+        this->m_arena = nullptr;
+    }
+    if ( this->m_sqes ) {
+        munmap(this->m_sqes, this->m_sqesSize);
+        this->m_sqes = nullptr;
+    }
+    if ( this->m_cqRing && this->m_cqRing != this->m_sqRing ) {
+        munmap(this->m_cqRing, this->m_cqRingSize);
+    }
+    this->m_cqRing = nullptr;
+    if ( this->m_sqRing ) {
+        munmap(this->m_sqRing, this->m_sqRingSize);
+        this->m_sqRing = nullptr;
+    }
+    if ( this->m_ringFd >= 0 ) {
+        // 关闭 ring 时内核自动注销固定缓冲区
+        close(this->m_ringFd);
+        this->m_ringFd = -1;
+    }
+
+    this->m_buffers.clear();
+    this->m_filling = -1;
+    this->m_pending = 0;
+    this->m_inflight = 0;
+    this->m_fixed = false;
+}
+
+// 取得一个空闲缓冲区, 全部在途时阻塞等待完成
+int UringWriter::acquireBuffer() {
+
+    while ( true ) {
+        for ( int i = 0; i < this->m_buffers.size(); i++ ) {
+            if ( !this->m_buffers[i].busy && i != this->m_filling ) {
+                this->m_buffers[i].len = 0;
+                this->m_buffers[i].done = 0;
+                return i;
+            }
+        }
+
+        if ( this->m_pending > 0 ) {
+            this->enter(this->m_pending, 0, 0);
+        }
+        this->reap(this->m_inflight > 0);
+    }
+}
+
+bool UringWriter::queueBuffer(const int index) {
+
+    auto &buffer = this->m_buffers[index];
+
+    const unsigned tail = *this->m_sqTail;
+    const unsigned slot = tail & *this->m_sqMask;
+    auto *sqe = static_cast<io_uring_sqe *>(this->m_sqes) + slot;
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqe->fd = this->m_fd;
+    sqe->off = buffer.offset + buffer.done;
+    sqe->user_data = index;
+
+    if ( this->m_fixed ) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->addr = reinterpret_cast<unsigned long long>(buffer.data + buffer.done);
+        sqe->len = buffer.len - buffer.done;
+        sqe->buf_index = index;
+    } else {
+        buffer.iov.base = buffer.data + buffer.done;
+        buffer.iov.len = buffer.len - buffer.done;
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->addr = reinterpret_cast<unsigned long long>(&buffer.iov);
+        sqe->len = 1;
+    }
+
+    this->m_sqArray[slot] = slot;
+    __atomic_store_n(this->m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    buffer.busy = true;
+    this->m_pending++;
+    return true;
+}
+
+bool UringWriter::queueSync() {
+
+    // 在途的 fdatasync 也占用队列, 超出深度时先回收
+    while ( this->m_pending + this->m_inflight >= URING_QUEUE_DEPTH ) {
+        if ( this->m_pending > 0 ) {
+            this->enter(this->m_pending, 0, 0);
+        }
+        this->reap(true);
+    }
+
+    const unsigned tail = *this->m_sqTail;
+    const unsigned slot = tail & *this->m_sqMask;
+    auto *sqe = static_cast<io_uring_sqe *>(this->m_sqes) + slot;
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->flags = IOSQE_IO_DRAIN;
+    sqe->fd = this->m_fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = URING_SYNC_TAG;
+
+    this->m_sqArray[slot] = slot;
+    __atomic_store_n(this->m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    this->m_pending++;
+    return true;
+}
+
+// 回收完成事件, 写了一部分的请求重新排队剩余部分
+void UringWriter::reap(const bool wait) {
+
+    if ( wait ) {
+        const unsigned head = *this->m_cqHead;
+        if ( head == __atomic_load_n(this->m_cqTail, __ATOMIC_ACQUIRE) ) {
+            this->enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+
+    unsigned head = *this->m_cqHead;
+    const unsigned tail = __atomic_load_n(this->m_cqTail, __ATOMIC_ACQUIRE);
+
+    bool requeued = false;
+    while ( head != tail ) {
+        const auto *cqe = static_cast<const io_uring_cqe *>(this->m_cqes) + (head & *this->m_cqMask);
+        head++;
+        this->m_inflight--;
+
+        if ( cqe->user_data == URING_SYNC_TAG ) {
+            if ( cqe->res < 0 ) this->m_failures++;
+            continue;
+        }
+
+        auto &buffer = this->m_buffers[static_cast<int>(cqe->user_data)];
+        buffer.busy = false;
+
+        if ( cqe->res <= 0 ) {
+            // 不再重试, 记下空洞起点, 之后的写入都被拒绝
+            this->m_failures++;
+            const qint64 hole = buffer.offset + buffer.done;
+            if ( this->m_failedAt < 0 || hole < this->m_failedAt ) this->m_failedAt = hole;
+            continue;
+        }
+
+        buffer.done += cqe->res;
+        if ( buffer.done < buffer.len && this->m_failedAt < 0 ) {
+            this->queueBuffer(static_cast<int>(cqe->user_data));
+            requeued = true;
+        }
+    }
+    __atomic_store_n(this->m_cqHead, head, __ATOMIC_RELEASE);
+
+    if ( requeued ) {
+        this->enter(this->m_pending, 0, 0);
+    }
+}
+
+qint64 UringWriter::pendingFrom() const {
+
+    qint64 lowest = -1;
+    for ( int i = 0; i < this->m_buffers.size(); i++ ) {
+        const auto &buffer = this->m_buffers[i];
+        if ( !buffer.busy && i != this->m_filling ) continue;
+        const qint64 offset = buffer.offset + buffer.done;
+        if ( lowest < 0 || offset < lowest ) lowest = offset;
+    }
+    return lowest;
+}
+
+bool UringWriter::write(qint64 offset, const char *data, qsizetype len) {
+
+    if ( !this->isActive() || this->m_failedAt >= 0 ) {
+        return false;
+    }
+
+    // 先顺手回收已完成的请求, 不阻塞
+    this->reap(false);
+
+    while ( len > 0 ) {
+        if ( this->m_failedAt >= 0 ) {
+            return false;
+        }
+
+        if ( this->m_filling >= 0 ) {
+            auto &filling = this->m_buffers[this->m_filling];
+            if ( filling.len == URING_BUFFER_SIZE || filling.offset + filling.len != offset ) {
+                this->queueBuffer(this->m_filling);
+                this->m_filling = -1;
+            }
+        }
+
+        if ( this->m_filling < 0 ) {
+            this->m_filling = this->acquireBuffer();
+            this->m_buffers[this->m_filling].offset = offset;
+        }
+
+        auto &buffer = this->m_buffers[this->m_filling];
+        const qsizetype n = qMin<qsizetype>(len, URING_BUFFER_SIZE - buffer.len);
+        memcpy(buffer.data + buffer.len, data, n);
+        buffer.len += n;
+
+        offset += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool UringWriter::submit() {
+
+    if ( !this->isActive() || this->m_failedAt >= 0 ) {
+        return false;
+    }
+
+    if ( this->m_filling >= 0 ) {
+        this->queueBuffer(this->m_filling);
+        this->m_filling = -1;
+    }
+
+    if ( this->m_syncEachFlush && this->m_pending > 0 ) {
+        this->queueSync();
+    }
+
+    if ( this->m_pending > 0 && this->enter(this->m_pending, 0, 0) < 0 ) {
+        // 提交不出去的部分同样视为失败
+        this->m_failures++;
+        this->m_failedAt = this->pendingFrom();
+        return false;
+    }
+
+    this->reap(false);
+    return this->m_failedAt < 0;
+}
+
+#else
+
+bool UringWriter::supported() { return false; }
+bool UringWriter::setup(const int fd, const bool syncEachFlush) { (void)fd; (void)syncEachFlush; return false; }
+void UringWriter::teardown() {}
+bool UringWriter::write(const qint64 offset, const char *data, const qsizetype len) { (void)offset; (void)data; (void)len; return false; }
+bool UringWriter::submit() { return false; }
+qint64 UringWriter::pendingFrom() const { return -1; }
+
+#endif
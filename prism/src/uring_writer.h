@@ -0,0 +1,124 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/18.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef PRISM_URING_WRITER_H
+#define PRISM_URING_WRITER_H
+
+#include <QtGlobal>
+#include <QList>
+
+
+// 注册缓冲区数量与大小, 同时在途的写请求不超过缓冲区数量
+#define URING_BUFFER_COUNT          16
+#define URING_BUFFER_SIZE           (256 * 1024)
+// 提交队列深度: 每个缓冲区一个写请求, 再加上链接的 fsync
+#define URING_QUEUE_DEPTH           (URING_BUFFER_COUNT * 2)
+
+
+// io_uring 异步写文件, 仅 Linux
+// 直接使用系统调用, 不依赖 liburing; 内核不支持时 setup 返回 false, 由调用方退回普通写
+// 数据先拷贝进注册过的固定缓冲区, 以显式偏移提交 WRITE_FIXED, 完成事件非阻塞回收
+// 只有缓冲区全部在途时写入方才会等待
+class UringWriter {
+
+public:
+    UringWriter() = default;
+    ~UringWriter() { this->teardown(); }
+
+    UringWriter(const UringWriter&) = delete;
+    UringWriter& operator=(const UringWriter&) = delete;
+
+    static bool supported();
+
+    // syncEachFlush 为 true 时每次 submit 追加一个 fdatasync, 以 IOSQE_IO_DRAIN 排在之前所有写请求之后
+    bool setup(int fd, bool syncEachFlush);
+    // 等待所有在途请求完成后释放, 失败偏移与失败数保留到下次 setup
+    void teardown();
+    bool isActive() const { return this->m_ringFd >= 0; }
+
+    // 拷贝进固定缓冲区, 满一块即排队
+    bool write(qint64 offset, const char *data, qsizetype len);
+    // 把已排队的请求提交给内核, 一次写盘调用一次
+    bool submit();
+
+    // 失败的写请求与 fdatasync 数
+    unsigned long long failures() const { return this->m_failures; }
+    // 首个失败的写请求未写出部分的文件偏移, -1 表示没有
+    // 写请求失败后文件在该处出现空洞, 之后 write 与 submit 都返回 false, 由调用方截断文件并改用普通写
+    qint64 failedAt() const { return this->m_failedAt; }
+    // 尚未确认写完的最低文件偏移, 都已写完时为 -1
+    qint64 pendingFrom() const;
+
+private:
+    typedef struct BUFFER_ {
+        char       *data;
+        struct {
+            void   *base;
+            size_t  len;
+        }           iov;            // 未能注册固定缓冲区时 WRITEV 使用
+        qint64      offset;         // 文件偏移
+        unsigned    len;            // 已填充
+        unsigned    done;           // 已完成写入
+        bool        busy;           // 已提交等待完成
+    } BUFFER;
+
+    bool queueBuffer(int index);
+    bool queueSync();
+    int acquireBuffer();
+    void reap(bool wait);
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    int m_ringFd{-1};
+    int m_fd{-1};
+    bool m_syncEachFlush{false};
+    // 缓冲区注册成功使用 WRITE_FIXED, 否则退回 WRITEV
+    bool m_fixed{false};
+
+    void *m_sqRing{nullptr};
+    size_t m_sqRingSize{0};
+    void *m_cqRing{nullptr};
+    size_t m_cqRingSize{0};
+    void *m_sqes{nullptr};
+    size_t m_sqesSize{0};
+
+    unsigned *m_sqHead{nullptr};
+    unsigned *m_sqTail{nullptr};
+    unsigned *m_sqMask{nullptr};
+    unsigned *m_sqArray{nullptr};
+    unsigned *m_cqHead{nullptr};
+    unsigned *m_cqTail{nullptr};
+    unsigned *m_cqMask{nullptr};
+    void *m_cqes{nullptr};
+
+    char *m_arena{nullptr};
+    QList<BUFFER> m_buffers{};
+    // 正在填充的缓冲区, -1 表示没有
+    int m_filling{-1};
+
+    unsigned m_pending{0};          // 已放入 SQ 未提交
+    unsigned m_inflight{0};         // 已提交未完成
+    unsigned long long m_failures{0};
+    qint64 m_failedAt{-1};
+};
+
+
+#endif //PRISM_URING_WRITER_H
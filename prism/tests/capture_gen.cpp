@@ -0,0 +1,173 @@
+/**
+ *  Copyright 2025, LeNidViolet
+ *  Created by LeNidViolet on 2025/08/20.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+// 往返测试用的抓包生成器, 由 test_capture_roundtrip.py 调用
+// 用法: capture_gen <抓包文件> [--format pcap|pcapng] [--lean] [--port-base N]
+//
+// 不开写线程, 经 PacketDumper 的公开接口写出一段内容固定的抓包与 .idx 索引:
+// TCP 流 1, 2 (IPv4) 与 3 (IPv6), UDP 流 1 (IPv4) 与 2 (IPv6) 交错收发, TCP 块跨越 MSS 与写盘阈值
+// TCP 流 1 中途结束, 之后建立 TCP 流 4
+// 文件已存在时追加一个新的段, 流 id 从头编号, 以 --port-base 区分两段中同 id 的流
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include "dump.h"
+#include "flow_registry.h"
+
+
+#define GEN_ROUNDS                  400
+#define GEN_TCP_MSS                 1460
+
+
+typedef struct GEN_FLOW_ {
+    bool            isStream;
+    int             index;
+    const char     *local;
+    const char     *domain;
+    const char     *remote;
+    unsigned short  remotePort;
+} GEN_FLOW;
+
+static const GEN_FLOW GEN_FLOWS[] = {
+    {true,  1, "10.0.0.2", "one.example",   "93.184.216.34", 443},
+    {true,  2, "10.0.0.2", nullptr,         "198.51.100.7",  80},
+    {true,  3, "fd00::2",  "three.example", "2001:db8::1",   443},
+    {false, 1, "10.0.0.2", nullptr,         "192.0.2.53",    53},
+    {false, 2, "fd00::2",  nullptr,         "2001:db8::35",  53},
+    {true,  4, "10.0.0.2", "four.example",  "203.0.113.9",   8443},
+};
+#define GEN_LATE_FLOW               5       // GEN_FLOWS 中从 GEN_ROUNDS / 2 开始的流
+
+
+// 按流与轮次确定的内容, 同一参数两次生成完全相同
+static QByteArray makePayload(const int flow, const int round, const qsizetype len) {
+
+    QByteArray payload(len, '\0');
+    quint32 state = static_cast<quint32>(flow * 7919 + round * 104729 + 1);
+    for ( qsizetype i = 0; i < len; i++ ) {
+        state = state * 1103515245u + 12345u;
+        payload[i] = static_cast<char>(state >> 24);
+    }
+    return payload;
+}
+
+static void openFlow(PacketDumper &dumper, const GEN_FLOW &flow, const unsigned short portBase,
+                     QList<PoolPtr<FLOW_RECORD>> &records, const int slot) {
+
+    records[slot] = FlowRegistry::instance().open(flow.isStream, flow.index, flow.local,
+        static_cast<unsigned short>(portBase + slot), flow.domain ? flow.domain : flow.remote,
+        flow.remote, flow.remotePort);
+    if ( flow.isStream ) {
+        dumper.onStreamConnectionMade(*records[slot]);
+    } else {
+        dumper.onDgramConnectionMade(*records[slot]);
+    }
+}
+
+static void closeFlow(PacketDumper &dumper, const GEN_FLOW &flow, QList<PoolPtr<FLOW_RECORD>> &records, const int slot) {
+
+    const auto record = FlowRegistry::instance().close(flow.isStream, flow.index);
+    if ( flow.isStream ) {
+        dumper.onStreamTeardown(*record);
+    } else {
+        dumper.onDgramTeardown(*record);
+    }
+    records[slot] = nullptr;
+}
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Write a fixed capture and index through PacketDumper"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("capture"), QStringLiteral("Capture file, appended when it exists"));
+    const QCommandLineOption formatOption(QStringLiteral("format"),
+        QStringLiteral("pcap or pcapng"), QStringLiteral("format"), QStringLiteral("pcap"));
+    const QCommandLineOption leanOption(QStringLiteral("lean"),
+        QStringLiteral("Raw IP link type without synthetic ACKs"));
+    const QCommandLineOption portOption(QStringLiteral("port-base"),
+        QStringLiteral("First local port"), QStringLiteral("port"), QStringLiteral("40000"));
+    parser.addOption(formatOption);
+    parser.addOption(leanOption);
+    parser.addOption(portOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if ( args.size() != 1 ) {
+        parser.showHelp(1);
+    }
+    const QString format = parser.value(formatOption);
+    if ( format != QStringLiteral("pcap") && format != QStringLiteral("pcapng") ) {
+        QTextStream(stderr) << "unknown format " << format << Qt::endl;
+        return 1;
+    }
+    const auto portBase = static_cast<unsigned short>(parser.value(portOption).toUInt());
+
+    PacketDumper &dumper = PacketDumper::instance();
+    dumper.setPcapFilePath(args.first());
+    dumper.setCaptureFormat(format == QStringLiteral("pcapng") ? CAPTURE_FORMAT_PCAPNG : CAPTURE_FORMAT_PCAP);
+    dumper.setLeanCapture(parser.isSet(leanOption));
+    dumper.setCaptureIndex(true);
+    dumper.setTcpMss(GEN_TCP_MSS);
+    dumper.start(false);
+
+    const int flowCount = sizeof(GEN_FLOWS) / sizeof(GEN_FLOWS[0]);
+    QList<PoolPtr<FLOW_RECORD>> records(flowCount);
+    for ( int slot = 0; slot < GEN_LATE_FLOW; slot++ ) {
+        openFlow(dumper, GEN_FLOWS[slot], portBase, records, slot);
+    }
+
+    for ( int round = 0; round < GEN_ROUNDS; round++ ) {
+        if ( round == GEN_ROUNDS / 2 ) {
+            closeFlow(dumper, GEN_FLOWS[0], records, 0);
+            openFlow(dumper, GEN_FLOWS[GEN_LATE_FLOW], portBase, records, GEN_LATE_FLOW);
+        }
+
+        for ( int slot = 0; slot < flowCount; slot++ ) {
+            if ( !records[slot] ) continue;
+
+            const bool sendOut = (round + slot) % 3 == 0;
+            if ( GEN_FLOWS[slot].isStream ) {
+                const QByteArray payload = makePayload(slot, round, (round * 7919 + slot * 131) % 20000 + 1);
+                dumper.onPlainStream(*records[slot], payload.constData(), payload.size(), sendOut);
+            } else {
+                const QByteArray payload = makePayload(slot, round, (round * 131 + slot * 17) % 1400 + 1);
+                dumper.onPlainDgram(*records[slot], payload.constData(), payload.size(), sendOut);
+            }
+        }
+    }
+
+    for ( int slot = 0; slot < flowCount; slot++ ) {
+        if ( records[slot] ) closeFlow(dumper, GEN_FLOWS[slot], records, slot);
+    }
+    dumper.stop();
+
+    const DUMP_STATS stats = dumper.getDumpStats();
+    if ( stats.drops || stats.ioErrors ) {
+        QTextStream(stderr) << "capture dropped " << stats.drops << " batches, " << stats.ioErrors << " io errors" << Qt::endl;
+        return 1;
+    }
+    return 0;
+}
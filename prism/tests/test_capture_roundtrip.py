@@ -0,0 +1,214 @@
+"""Round trip: PacketDumper -> capture + .idx -> PRISMEXTRACT.
+
+capture_gen writes two sections into one file (the second run appends and
+restarts flow ids with other local ports). For every flow listed by
+PRISMEXTRACT --list, the extracted file must parse and hold exactly the packet
+records of that flow's 5-tuple inside that section, byte for byte and in order.
+
+Run through CTest (PRISM_BUILD_TESTS=ON), or directly with
+PRISM_CAPTURE_GEN and PRISM_EXTRACT pointing at the built binaries.
+"""
+import collections
+import ipaddress
+import os
+import struct
+import subprocess
+
+import pytest
+
+CAPTURE_GEN = os.environ.get("PRISM_CAPTURE_GEN")
+EXTRACT = os.environ.get("PRISM_EXTRACT")
+
+pytestmark = pytest.mark.skipif(
+    not (CAPTURE_GEN and EXTRACT), reason="PRISM_CAPTURE_GEN / PRISM_EXTRACT not set")
+
+PORT_BASES = (40000, 41000)
+
+PCAP_MAGIC = 0xA1B2C3D4
+PCAPNG_SHB = 0x0A0D0D0A
+PCAPNG_IDB = 0x00000001
+PCAPNG_NRB = 0x00000004
+PCAPNG_EPB = 0x00000006
+
+LINKTYPE_ETHERNET = 1
+LINKTYPE_RAW = 101
+
+PROTOCOL_TCP = 6
+PROTOCOL_UDP = 17
+
+# kind: "packet" or the pcapng block type; raw: the whole record or block
+Record = collections.namedtuple("Record", "offset kind raw packet linktype")
+Flow = collections.namedtuple("Flow", "spec section protocol endpoints")
+
+
+def read_capture(path):
+    """Parse a pcap or pcapng file written on this host; fail on any trailing garbage."""
+    with open(path, "rb") as f:
+        data = f.read()
+    assert len(data) >= 24, "capture too short"
+
+    records = []
+    (magic,) = struct.unpack_from("<I", data, 0)
+    if magic == PCAP_MAGIC:
+        (linktype,) = struct.unpack_from("<I", data, 20)
+        pos = 24
+        while pos < len(data):
+            assert pos + 16 <= len(data), "truncated pcap record header at %d" % pos
+            _, _, incl_len, orig_len = struct.unpack_from("<IIII", data, pos)
+            end = pos + 16 + incl_len
+            assert incl_len == orig_len and end <= len(data), "bad pcap record at %d" % pos
+            records.append(Record(pos, "packet", data[pos:end], data[pos + 16:end], linktype))
+            pos = end
+        return records
+
+    assert magic == PCAPNG_SHB, "unknown capture magic %#x" % magic
+    linktype = None
+    pos = 0
+    while pos < len(data):
+        assert pos + 12 <= len(data), "truncated pcapng block at %d" % pos
+        block_type, block_len = struct.unpack_from("<II", data, pos)
+        end = pos + block_len
+        assert block_len >= 12 and block_len % 4 == 0 and end <= len(data), "bad pcapng block at %d" % pos
+        (tail_len,) = struct.unpack_from("<I", data, end - 4)
+        assert tail_len == block_len, "pcapng block length mismatch at %d" % pos
+
+        if block_type == PCAPNG_SHB:
+            linktype = None
+        elif block_type == PCAPNG_IDB:
+            (linktype,) = struct.unpack_from("<H", data, pos + 8)
+        elif block_type == PCAPNG_EPB:
+            assert linktype is not None, "EPB before IDB at %d" % pos
+            (cap_len,) = struct.unpack_from("<I", data, pos + 20)
+            packet = data[pos + 28:pos + 28 + cap_len]
+            records.append(Record(pos, "packet", data[pos:end], packet, linktype))
+            pos = end
+            continue
+        records.append(Record(pos, block_type, data[pos:end], None, linktype))
+        pos = end
+    return records
+
+
+def packet_tuple(packet, linktype):
+    """(protocol, (ip, port), (ip, port)) of a synthesized Ethernet or raw IP packet."""
+    if linktype == LINKTYPE_ETHERNET:
+        packet = packet[14:]
+    else:
+        assert linktype == LINKTYPE_RAW, "unexpected link type %d" % linktype
+
+    version = packet[0] >> 4
+    if version == 4:
+        ihl = (packet[0] & 0x0F) * 4
+        protocol = packet[9]
+        src, dst = packet[12:16], packet[16:20]
+        l4 = packet[ihl:]
+    else:
+        assert version == 6, "unexpected IP version %d" % version
+        protocol = packet[6]
+        src, dst = packet[8:24], packet[24:40]
+        l4 = packet[40:]
+
+    sport, dport = struct.unpack_from("!HH", l4, 0)
+    return (protocol,
+            (ipaddress.ip_address(bytes(src)), sport),
+            (ipaddress.ip_address(bytes(dst)), dport))
+
+
+def parse_endpoint(text):
+    host, port = text.rsplit(":", 1)
+    return ipaddress.ip_address(host.strip("[]")), int(port)
+
+
+def list_flows(capture):
+    result = subprocess.run([EXTRACT, "--list", capture], capture_output=True, text=True, check=True)
+    flows = []
+    for line in result.stdout.splitlines():
+        spec, endpoints = line.split("\t")[:2]
+        section, flow_id = spec.split("/")
+        protocol = PROTOCOL_TCP if flow_id.startswith("tcp:") else PROTOCOL_UDP
+        src, dst = endpoints.split(" -> ")
+        flows.append(Flow(spec, int(section), protocol,
+                          frozenset((parse_endpoint(src), parse_endpoint(dst)))))
+    return flows
+
+
+def flow_packets(records, flow, start, end):
+    """Raw packet records of the flow whose offsets fall in [start, end)."""
+    selected = []
+    for record in records:
+        if record.kind != "packet" or not start <= record.offset < end:
+            continue
+        protocol, src, dst = packet_tuple(record.packet, record.linktype)
+        if protocol == flow.protocol and frozenset((src, dst)) == flow.endpoints:
+            selected.append(record.raw)
+    return selected
+
+
+def extract(capture, output, *specs):
+    args = [EXTRACT, capture, "--output", output]
+    for spec in specs:
+        args += ["--flow", spec]
+    return subprocess.run(args, capture_output=True, text=True)
+
+
+def extracted_packets(output):
+    records = read_capture(output)
+    # besides packets only section headers and name resolution blocks may appear
+    for record in records:
+        assert record.kind in ("packet", PCAPNG_SHB, PCAPNG_IDB, PCAPNG_NRB), \
+            "unexpected block %r in extracted output" % (record.kind,)
+    return [record.raw for record in records if record.kind == "packet"]
+
+
+@pytest.fixture(scope="module", params=[
+    ("pcap", False), ("pcapng", False), ("pcap", True), ("pcapng", True),
+], ids=["pcap", "pcapng", "pcap-lean", "pcapng-lean"])
+def capture(request, tmp_path_factory):
+    fmt, lean = request.param
+    path = str(tmp_path_factory.mktemp("capture") / ("capture." + fmt))
+
+    boundaries = [0]
+    for port_base in PORT_BASES:
+        args = [CAPTURE_GEN, path, "--format", fmt, "--port-base", str(port_base)]
+        if lean:
+            args.append("--lean")
+        subprocess.run(args, check=True)
+        boundaries.append(os.path.getsize(path))
+
+    return path, boundaries, read_capture(path)
+
+
+def test_both_sections_are_indexed(capture):
+    path, _, _ = capture
+    flows = list_flows(path)
+    assert sorted({flow.section for flow in flows}) == [0, 1]
+    for section in (0, 1):
+        specs = sorted(flow.spec.split("/")[1] for flow in flows if flow.section == section)
+        assert specs == ["tcp:1", "tcp:2", "tcp:3", "tcp:4", "udp:1", "udp:2"]
+
+
+def test_every_flow_round_trips(capture, tmp_path):
+    path, boundaries, records = capture
+    for flow in list_flows(path):
+        expected = flow_packets(records, flow, boundaries[flow.section], boundaries[flow.section + 1])
+        assert expected, "%s has no packets in the capture" % flow.spec
+
+        output = str(tmp_path / (flow.spec.replace("/", "_").replace(":", "_") + ".out"))
+        result = extract(path, output, flow.spec)
+        assert result.returncode == 0, result.stderr
+        assert extracted_packets(output) == expected, flow.spec
+
+
+def test_plain_id_spans_sections(capture, tmp_path):
+    path, boundaries, records = capture
+    flows = [flow for flow in list_flows(path) if flow.spec.endswith("/tcp:2")]
+    assert len(flows) == 2
+
+    expected = []
+    for flow in flows:
+        expected += flow_packets(records, flow, boundaries[flow.section], boundaries[flow.section + 1])
+
+    output = str(tmp_path / "tcp_2.out")
+    result = extract(path, output, "tcp:2")
+    assert result.returncode == 0, result.stderr
+    assert "appears in 2 sections" in result.stderr
+    assert extracted_packets(output) == expected